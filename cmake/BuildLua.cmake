@@ -27,6 +27,11 @@ macro(build_lua LUA_VERSION)
         set(LDFLAGS "${LDFLAGS} -fsanitize=address")
     endif (ENABLE_ASAN)
 
+    if (ENABLE_TSAN)
+        set(CFLAGS "${CFLAGS} -fsanitize=thread")
+        set(LDFLAGS "${LDFLAGS} -fsanitize=thread")
+    endif (ENABLE_TSAN)
+
     if (ENABLE_UBSAN)
         string(JOIN "," NO_SANITIZE_FLAGS
             # lvm.c:luaV_execute()
@@ -56,6 +61,25 @@ macro(build_lua LUA_VERSION)
         set(LDFLAGS "${LDFLAGS} -fprofile-instr-generate -fprofile-arcs -fcoverage-mapping -ftest-coverage")
     endif (ENABLE_COV)
 
+    # Two-stage profile-guided optimization, see cmake/LuaPGO.cmake.
+    if (ENABLE_LUA_PGO_INSTRUMENT)
+        set(CFLAGS "${CFLAGS} -fprofile-instr-generate")
+        set(LDFLAGS "${LDFLAGS} -fprofile-instr-generate")
+    endif (ENABLE_LUA_PGO_INSTRUMENT)
+
+    set(LUA_AR "ar rc")
+    set(LUA_RANLIB "ranlib")
+    if (LUA_PGO_PROFDATA)
+        set(CFLAGS "${CFLAGS} -fprofile-instr-use=${LUA_PGO_PROFDATA}")
+        set(CFLAGS "${CFLAGS} -Wno-profile-instr-unprofiled")
+        set(CFLAGS "${CFLAGS} -Wno-profile-instr-out-of-date")
+        set(CFLAGS "${CFLAGS} -flto=thin")
+        set(LDFLAGS "${LDFLAGS} -flto=thin -fuse-ld=lld")
+        # Objects with LLVM bitcode require an LLVM-aware archiver.
+        set(LUA_AR "${LLVM_AR} rc")
+        set(LUA_RANLIB "${LLVM_RANLIB}")
+    endif (LUA_PGO_PROFDATA)
+
     if(ENABLE_LAPI_TESTS)
         # "relocation R_X86_64_PC32 against symbol `lua_isnumber'
         # can not be used when making a shared object; recompile
@@ -91,6 +115,8 @@ macro(build_lua LUA_VERSION)
         BUILD_COMMAND cd <SOURCE_DIR> && make -j CC=${CMAKE_C_COMPILER}
                                                  MYCFLAGS=${CFLAGS}
                                                  MYLDFLAGS=${LDFLAGS}
+                                                 "AR=${LUA_AR}"
+                                                 RANLIB=${LUA_RANLIB}
                                                  LF_PATH=${LibFuzzerObjDir}
         INSTALL_COMMAND ""
 
@@ -108,4 +134,6 @@ macro(build_lua LUA_VERSION)
 
     unset(LUA_BINARY_DIR)
     unset(LUA_PATCH_PATH)
+    unset(LUA_AR)
+    unset(LUA_RANLIB)
 endmacro(build_lua)
@@ -31,6 +31,11 @@ macro(build_luajit LJ_VERSION)
         set(LDFLAGS "${LDFLAGS} -fsanitize=address")
     endif (ENABLE_ASAN)
 
+    if (ENABLE_TSAN)
+        set(CFLAGS "${CFLAGS} -fsanitize=thread")
+        set(LDFLAGS "${LDFLAGS} -fsanitize=thread")
+    endif (ENABLE_TSAN)
+
     if (ENABLE_UBSAN)
         string(JOIN "," NO_SANITIZE_FLAGS
             # Misaligned pseudo-pointers are used to determine
@@ -80,6 +85,23 @@ macro(build_luajit LJ_VERSION)
         set(LDFLAGS "${LDFLAGS} -fprofile-instr-generate -fprofile-arcs -fcoverage-mapping -ftest-coverage")
     endif (ENABLE_COV)
 
+    # Two-stage profile-guided optimization, see cmake/LuaPGO.cmake.
+    if (ENABLE_LUA_PGO_INSTRUMENT)
+        set(CFLAGS "${CFLAGS} -fprofile-instr-generate")
+        set(LDFLAGS "${LDFLAGS} -fprofile-instr-generate")
+    endif (ENABLE_LUA_PGO_INSTRUMENT)
+
+    set(LJ_TARGET_AR "ar rcus")
+    if (LUA_PGO_PROFDATA)
+        set(CFLAGS "${CFLAGS} -fprofile-instr-use=${LUA_PGO_PROFDATA}")
+        set(CFLAGS "${CFLAGS} -Wno-profile-instr-unprofiled")
+        set(CFLAGS "${CFLAGS} -Wno-profile-instr-out-of-date")
+        set(CFLAGS "${CFLAGS} -flto=thin")
+        set(LDFLAGS "${LDFLAGS} -flto=thin -fuse-ld=lld")
+        # Objects with LLVM bitcode require an LLVM-aware archiver.
+        set(LJ_TARGET_AR "${LLVM_AR} rcus")
+    endif (LUA_PGO_PROFDATA)
+
     if(ENABLE_LAPI_TESTS)
         # "relocation R_X86_64_PC32 against symbol `lua_isnumber'
         # can not be used when making a shared object; recompile
@@ -117,6 +139,7 @@ macro(build_luajit LJ_VERSION)
                                                  CFLAGS=${CFLAGS}
                                                  LDFLAGS=${LDFLAGS}
                                                  HOST_CFLAGS=-fno-sanitize=undefined
+                                                 "TARGET_AR=${LJ_TARGET_AR}"
                                                  LF_PATH=${LibFuzzerObjDir}
                                                  -C src
         INSTALL_COMMAND ""
@@ -136,4 +159,5 @@ macro(build_luajit LJ_VERSION)
 
     unset(LJ_SOURCE_DIR)
     unset(LJ_BINARY_DIR)
+    unset(LJ_TARGET_AR)
 endmacro(build_luajit)
@@ -0,0 +1,46 @@
+# The module adds a target `lua-pgo-profdata` that collects
+# a profile for the profile-guided optimization (PGO) of the Lua
+# runtime. The build with PGO is performed in two stages:
+#
+# 1. Lua runtime is built with ENABLE_LUA_PGO_INSTRUMENT=ON and
+#    the target `lua-pgo-profdata` replays the corpora through
+#    the Lua C API tests. Raw profiles are merged into a file
+#    `${LUA_PGO_DIR}/lua.profdata`.
+# 2. Lua runtime is rebuilt in a separate build directory with
+#    LUA_PGO_PROFDATA=<path to lua.profdata>, the runtime is
+#    compiled with `-fprofile-instr-use` and ThinLTO.
+#
+# See https://clang.llvm.org/docs/UsersManual.html#profile-guided-optimization.
+
+find_program(LLVM_PROFDATA llvm-profdata)
+
+set(LUA_PGO_DIR "${PROJECT_BINARY_DIR}/pgo")
+set(LUA_PGO_PROFDATA_OUTPUT "${LUA_PGO_DIR}/lua.profdata")
+
+set(target_name "lua-pgo-profdata")
+if(NOT LLVM_PROFDATA)
+  set(MSG "${target_name} is a dummy target")
+  add_custom_target(${target_name}
+    COMMAND ${CMAKE_COMMAND} -E cmake_echo_color --red ${MSG}
+  )
+  message(WARNING "`llvm-profdata` is not found, "
+                  "so ${target_name} target is dummy.")
+  return()
+endif()
+
+file(MAKE_DIRECTORY ${LUA_PGO_DIR})
+# `RUNS=0` makes libFuzzer execute the initial corpus and exit,
+# so the profile reflects the corpus only.
+add_custom_target(${target_name}
+  COMMENT "Collecting profile for the Lua runtime"
+  COMMAND ${CMAKE_COMMAND} -E rm -f ${LUA_PGO_DIR}/*.profraw
+  COMMAND ${CMAKE_COMMAND} -E env
+          LLVM_PROFILE_FILE=${LUA_PGO_DIR}/%m-%p.profraw
+          RUNS=0
+          ${CMAKE_CTEST_COMMAND} -L capi --test-dir ${PROJECT_BINARY_DIR}
+  COMMAND ${LLVM_PROFDATA} merge --output=${LUA_PGO_PROFDATA_OUTPUT}
+          ${LUA_PGO_DIR}/*.profraw
+  WORKING_DIRECTORY ${PROJECT_BINARY_DIR}
+)
+
+message(STATUS "Lua runtime profile: ${LUA_PGO_PROFDATA_OUTPUT}")
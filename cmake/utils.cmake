@@ -33,6 +33,27 @@ function(lua_source varname filename symbolname)
     set(${varname} ${var} ${dstfile} PARENT_SCOPE)
 endfunction()
 
+# A helper function to generate a libFuzzer dictionary for a test
+# with names defined by the Lua runtime, see extra/gen_dict.lua.
+# A dictionary maintained by hand is merged, when it exists.
+function(lua_dictionary varname test_name base_dict)
+    set(dstfile ${PROJECT_BINARY_DIR}/dict/${test_name}.dict)
+    set(base_args "")
+    if (EXISTS ${base_dict})
+        set(base_args ${base_dict})
+    endif()
+    file(MAKE_DIRECTORY ${PROJECT_BINARY_DIR}/dict)
+
+    add_custom_command(OUTPUT ${dstfile}
+        COMMAND ${LUA_EXECUTABLE} ${PROJECT_SOURCE_DIR}/extra/gen_dict.lua
+                ${dstfile} ${base_args}
+        DEPENDS ${PROJECT_SOURCE_DIR}/extra/gen_dict.lua ${base_args}
+                ${LUA_LIBRARIES})
+    add_custom_target(${test_name}_dict ALL DEPENDS ${dstfile})
+
+    set(${varname} ${dstfile} PARENT_SCOPE)
+endfunction()
+
 macro(AppendFlags flags)
     foreach(flag ${ARGN})
         if (${flags})
@@ -0,0 +1,169 @@
+--[[
+SPDX-License-Identifier: ISC
+Copyright (c) 2023-2025, Sergey Bronnikov.
+
+The script generates a libFuzzer dictionary with names defined by
+a Lua runtime, that executes the script: global names, names of
+functions in libraries and loaded modules, keywords, metamethods,
+format specifiers and pattern items. A dictionary maintained by
+hand is copied to the beginning of the generated dictionary,
+generated tokens, that are already in it, are skipped.
+
+Usage: <lua> gen_dict.lua <output> [<base dictionary>]
+]]
+
+local out_path = arg[1]
+local base_path = arg[2]
+if not out_path then
+    io.stderr:write("Usage: gen_dict.lua <output> [<base dictionary>]\n")
+    os.exit(1)
+end
+
+-- Modules, that are not loaded by default.
+local optional_modules = {
+    "bit",
+    "ffi",
+    "jit",
+    "jit.profile",
+    "jit.util",
+    "string.buffer",
+    "table.clear",
+    "table.new",
+    "utf8",
+}
+
+local keywords = {
+    "and", "break", "do", "else", "elseif", "end", "false", "for",
+    "function", "goto", "if", "in", "local", "nil", "not", "or",
+    "repeat", "return", "then", "true", "until", "while",
+}
+
+local operators = {
+    "+", "-", "*", "/", "//", "%", "^", "#", "&", "~", "|", "<<", ">>",
+    "==", "~=", "<=", ">=", "<", ">", "=", "..", "...", "::", "[[", "]]",
+    "--", "--[[", "[==[", "]==]",
+}
+
+local metamethods = {
+    "__add", "__band", "__bnot", "__bor", "__bxor", "__call", "__close",
+    "__concat", "__div", "__eq", "__gc", "__idiv", "__index", "__ipairs",
+    "__le", "__len", "__lt", "__metatable", "__mod", "__mode", "__mul",
+    "__name", "__newindex", "__pairs", "__pow", "__shl", "__shr", "__sub",
+    "__tostring", "__unm",
+}
+
+-- Used by `string.format()`, `os.date()`, `string.pack()` and
+-- patterns.
+local format_items = {
+    "%a", "%b()", "%c", "%d", "%e", "%f", "%f[%w]", "%g", "%i", "%l",
+    "%o", "%p", "%q", "%s", "%u", "%w", "%x", "%X", "%%", "%5.2f",
+    "%-5d", "!*t", "*t", "<i4", ">I8", "=d", "s4", "z", "[^%s]", ".-",
+}
+
+local tokens = {}
+local seen = {}
+
+-- Escapes a token in a format of libFuzzer dictionaries.
+local function escape(token)
+    return (token:gsub("[%c\"\\\128-\255]", function(c)
+        if c == "\"" or c == "\\" then
+            return "\\" .. c
+        end
+        return ("\\x%02X"):format(c:byte())
+    end))
+end
+
+local function add(token)
+    if type(token) ~= "string" or token == "" then
+        return
+    end
+    local escaped = escape(token)
+    if seen[escaped] then
+        return
+    end
+    seen[escaped] = true
+    table.insert(tokens, escaped)
+end
+
+local function add_list(list)
+    for _, token in ipairs(list) do
+        add(token)
+    end
+end
+
+local function add_module(name, module)
+    add(name)
+    if type(module) ~= "table" then
+        return
+    end
+    for key, value in pairs(module) do
+        if type(key) == "string" then
+            add(key)
+            add(name .. "." .. key)
+            if type(value) == "function" then
+                add(name .. "." .. key .. "(")
+            end
+        end
+    end
+end
+
+-- Copy a base dictionary and mark its tokens as seen.
+local base = {}
+if base_path then
+    local f = io.open(base_path, "r")
+    if f then
+        for line in f:lines() do
+            table.insert(base, line)
+            local token = line:match("^%s*[%w_]*=?%s*\"(.*)\"%s*$")
+            if token then
+                seen[token] = true
+            end
+        end
+        f:close()
+    end
+end
+
+for _, name in ipairs(optional_modules) do
+    pcall(require, name)
+end
+for name, value in pairs(_G) do
+    if type(name) == "string" then
+        add(name)
+    end
+    if type(value) == "function" then
+        add(name .. "(")
+    end
+end
+for name, module in pairs(package.loaded) do
+    if type(name) == "string" and name ~= "_G" then
+        add_module(name, module)
+    end
+end
+local string_mt = getmetatable("")
+if type(string_mt) == "table" then
+    for key in pairs(string_mt) do
+        add(key)
+    end
+end
+add_list(metamethods)
+add_list(keywords)
+add_list(operators)
+add_list(format_items)
+add(_VERSION)
+if jit then
+    add(jit.version)
+end
+
+-- The order of `pairs()` is not defined.
+table.sort(tokens)
+
+local out = assert(io.open(out_path, "w"))
+for _, line in ipairs(base) do
+    out:write(line, "\n")
+end
+local version = jit and jit.version or _VERSION
+out:write(("# Generated by gen_dict.lua for %s.\n"):format(version))
+for _, token in ipairs(tokens) do
+    out:write("\"", token, "\"\n")
+end
+out:close()
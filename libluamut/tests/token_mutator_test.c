@@ -0,0 +1,139 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "token_mutate.h"
+
+#ifndef lengthof
+#  define lengthof(array) (sizeof (array) / sizeof ((array)[0]))
+#endif
+
+static const char *source =
+	"-- A comment.\n"
+	"local t = {1, 2.5e-3, 0x1p4}\n"
+	"--[==[ A long\ncomment. ]==]\n"
+	"function f(a, ...)\n"
+	"  while a < 10 do a = a + 1 end\n"
+	"  repeat a = a - 1 until a == 0\n"
+	"  return a .. [[long\nstring]] .. 'x\\'y'\n"
+	"end\n";
+
+static void
+test_tokenize(void)
+{
+	const char *src = "local s = 'a\\'b' .. [=[x]]=] -- c\nx = 0x1p-2 ... ~= @";
+	const char *expected[] = {
+		"local", "s", "=", "'a\\'b'", "..", "[=[x]]=]", "x", "=",
+		"0x1p-2", "...", "~=", "@",
+	};
+	const enum lua_token_type types[] = {
+		LUA_TOKEN_KEYWORD, LUA_TOKEN_NAME, LUA_TOKEN_OPERATOR,
+		LUA_TOKEN_STRING, LUA_TOKEN_OPERATOR, LUA_TOKEN_STRING,
+		LUA_TOKEN_NAME, LUA_TOKEN_OPERATOR, LUA_TOKEN_NUMBER,
+		LUA_TOKEN_OPERATOR, LUA_TOKEN_OPERATOR, LUA_TOKEN_OTHER,
+	};
+	struct lua_tokens tokens;
+	assert(lua_tokenize(src, strlen(src), &tokens) == 0);
+	assert(tokens.num == lengthof(expected));
+	for (size_t i = 0; i < tokens.num; i++) {
+		const struct lua_token *tok = &tokens.tokens[i];
+		assert(tok->type == types[i]);
+		assert(tok->len == strlen(expected[i]));
+		assert(memcmp(src + tok->offset, expected[i], tok->len) == 0);
+	}
+	lua_tokens_destroy(&tokens);
+}
+
+static void
+test_unfinished(void)
+{
+	const char *sources[] = { "x = 'abc\ny", "x = [[abc", "--[[ abc" };
+	for (size_t i = 0; i < lengthof(sources); i++) {
+		struct lua_tokens tokens;
+		const char *src = sources[i];
+		assert(lua_tokenize(src, strlen(src), &tokens) == 0);
+		for (size_t j = 0; j < tokens.num; j++)
+			assert(tokens.tokens[j].offset + tokens.tokens[j].len <=
+			       strlen(src));
+		lua_tokens_destroy(&tokens);
+	}
+}
+
+static void
+test_match(void)
+{
+	const char *src = "while f(function() end) do x = {[1] = 2} end";
+	struct lua_tokens tokens;
+	assert(lua_tokenize(src, strlen(src), &tokens) == 0);
+	/* `while` is closed by the last `end`. */
+	assert(tokens.tokens[0].match == tokens.num - 1);
+	/* `function` is closed by the first `end`. */
+	assert(tokens.tokens[3].match == 6);
+	/* `do` belongs to `while`. */
+	assert(tokens.tokens[8].match == SIZE_MAX);
+	lua_tokens_destroy(&tokens);
+}
+
+static void
+test_mutate(void)
+{
+	size_t size = strlen(source);
+	size_t max_size = size * 2;
+	uint8_t *data1 = malloc(max_size);
+	uint8_t *data2 = malloc(max_size);
+	assert(data1 != NULL && data2 != NULL);
+	size_t num_changed = 0;
+	for (unsigned int seed = 0; seed < 1000; seed++) {
+		memcpy(data1, source, size);
+		memcpy(data2, source, size);
+		size_t size1 = lua_token_mutate(data1, size, max_size, seed);
+		size_t size2 = lua_token_mutate(data2, size, max_size, seed);
+		assert(size1 != 0 && size1 <= max_size);
+		/* The same seed gives the same mutation. */
+		assert(size1 == size2 && memcmp(data1, data2, size1) == 0);
+		if (size1 != size || memcmp(data1, source, size) != 0)
+			num_changed++;
+	}
+	assert(num_changed > 900);
+	/* There are no tokens. */
+	memcpy(data1, " -- x", 5);
+	assert(lua_token_mutate(data1, 5, max_size, 0) == 0);
+	free(data1);
+	free(data2);
+}
+
+static void
+test_crossover(void)
+{
+	const char *src2 = "do print(1) end local x = (2 + 3) * {4}";
+	size_t size1 = strlen(source);
+	size_t size2 = strlen(src2);
+	size_t max_size = size1 + size2;
+	uint8_t *out = malloc(max_size);
+	assert(out != NULL);
+	size_t num_crossovers = 0;
+	for (unsigned int seed = 0; seed < 1000; seed++) {
+		size_t size = lua_token_crossover((const uint8_t *)source,
+						  size1,
+						  (const uint8_t *)src2, size2,
+						  out, max_size, seed);
+		assert(size <= max_size);
+		if (size != 0)
+			num_crossovers++;
+	}
+	assert(num_crossovers > 0);
+	free(out);
+}
+
+int
+main(void)
+{
+	test_tokenize();
+	test_unfinished();
+	test_match();
+	test_mutate();
+	test_crossover();
+}
@@ -0,0 +1,668 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright 2025, Sergey Bronnikov
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "token_mutate.h"
+
+#ifndef lengthof
+#  define lengthof(array) (sizeof (array) / sizeof ((array)[0]))
+#endif
+
+/* A number of attempts to find an applicable mutation. */
+#define MAX_ATTEMPTS 8
+
+static const char *const keywords[] = {
+	"and", "break", "do", "else", "elseif", "end", "false", "for",
+	"function", "goto", "if", "in", "local", "nil", "not", "or",
+	"repeat", "return", "then", "true", "until", "while",
+};
+
+/* Operators are ordered by length, the longest match is taken. */
+static const char *const operators[] = {
+	"...", "..", "==", "~=", "<=", ">=", "<<", ">>", "//", "::",
+	"+", "-", "*", "/", "%", "^", "#", "&", "~", "|", "<", ">", "=",
+	"(", ")", "{", "}", "[", "]", ";", ":", ",", ".",
+};
+
+static const char *const binary_operators[] = {
+	"+", "-", "*", "/", "%", "^", "..", "==", "~=", "<", "<=", ">",
+	">=", "and", "or", "//", "&", "|", "~", "<<", ">>",
+};
+
+static const char *const names[] = {
+	"_G", "_ENV", "_VERSION", "assert", "collectgarbage", "coroutine",
+	"debug", "error", "getmetatable", "ipairs", "load", "math", "next",
+	"pairs", "pcall", "rawequal", "rawget", "rawlen", "rawset",
+	"select", "setmetatable", "string", "table", "tonumber",
+	"tostring", "type", "utf8", "xpcall",
+};
+
+static const char *const numbers[] = {
+	"0", "1", "(-1)", "0.5", "1e308", "(-1e308)", "(2^53)",
+	"0x7fffffff", "0xffffffff", "(-0.0)", "(1/0)", "(-1/0)", "(0/0)",
+	"255", "256", "65536", "4294967296", "9007199254740993",
+};
+
+static const char *const strings[] = {
+	"\"\"", "\"\\0\"", "\"\\255\"", "\"%s%s%s\"", "\"%d\"", "\"[%a\"",
+	"\"%f[%w]\"", "\"(.-)\"", "((\"x\"):rep(64))", "\"nan\"",
+	"\"0x10\"", "\" 1e1 \"",
+};
+
+static uint32_t
+rng_next(uint32_t *state)
+{
+	/* xorshift32. */
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static void
+rng_init(uint32_t *state, unsigned int seed)
+{
+	*state = seed * 2654435761u + 1;
+	if (*state == 0)
+		*state = 1;
+}
+
+static int
+is_name_char(char c)
+{
+	return isalnum((unsigned char)c) || c == '_';
+}
+
+static int
+is_one_of(const char *s, size_t len, const char *const *list, size_t num)
+{
+	for (size_t i = 0; i < num; i++) {
+		if (strlen(list[i]) == len && memcmp(s, list[i], len) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+static int
+token_is(const char *src, const struct lua_token *tok, const char *text)
+{
+	return tok->len == strlen(text) &&
+	       memcmp(src + tok->offset, text, tok->len) == 0;
+}
+
+/*
+ * Returns a level of a long bracket `[==[` starting at `pos` or -1
+ * when there is no long bracket.
+ */
+static int
+long_bracket_level(const char *src, size_t size, size_t pos)
+{
+	if (pos >= size || src[pos] != '[')
+		return -1;
+	size_t i = pos + 1;
+	while (i < size && src[i] == '=')
+		i++;
+	if (i < size && src[i] == '[')
+		return (int)(i - pos - 1);
+	return -1;
+}
+
+/* Returns a position after a closing long bracket or `size`. */
+static size_t
+skip_long_bracket(const char *src, size_t size, size_t pos, int level)
+{
+	pos += level + 2;
+	for (; pos < size; pos++) {
+		if (src[pos] != ']')
+			continue;
+		size_t i = pos + 1;
+		while (i < size && src[i] == '=')
+			i++;
+		if (i < size && src[i] == ']' && (int)(i - pos - 1) == level)
+			return i + 1;
+	}
+	return size;
+}
+
+static size_t
+skip_short_string(const char *src, size_t size, size_t pos)
+{
+	char quote = src[pos++];
+	while (pos < size) {
+		char c = src[pos];
+		if (c == quote)
+			return pos + 1;
+		/* An unfinished string. */
+		if (c == '\n' || c == '\r')
+			return pos;
+		pos += c == '\\' ? 2 : 1;
+	}
+	return size;
+}
+
+static size_t
+skip_numeral(const char *src, size_t size, size_t pos)
+{
+	const char *exp = "Ee";
+	if (src[pos] == '0' && pos + 1 < size &&
+	    (src[pos + 1] == 'x' || src[pos + 1] == 'X')) {
+		exp = "Pp";
+		pos += 2;
+	}
+	while (pos < size) {
+		char c = src[pos];
+		if (c == exp[0] || c == exp[1]) {
+			pos++;
+			if (pos < size && (src[pos] == '+' || src[pos] == '-'))
+				pos++;
+		} else if (is_name_char(c) || c == '.') {
+			pos++;
+		} else {
+			break;
+		}
+	}
+	return pos;
+}
+
+static int
+tokens_push(struct lua_tokens *tokens, enum lua_token_type type,
+	    size_t offset, size_t len)
+{
+	if (tokens->num == tokens->capacity) {
+		size_t capacity = tokens->capacity ? tokens->capacity * 2 : 64;
+		struct lua_token *t = realloc(tokens->tokens,
+					      capacity * sizeof(*t));
+		if (t == NULL)
+			return -1;
+		tokens->tokens = t;
+		tokens->capacity = capacity;
+	}
+	struct lua_token *tok = &tokens->tokens[tokens->num++];
+	tok->type = type;
+	tok->offset = offset;
+	tok->len = len;
+	tok->match = SIZE_MAX;
+	return 0;
+}
+
+/*
+ * Matches brackets and blocks: `function`, `if`, `do`, `while`
+ * and `for` are closed by `end`, `repeat` is closed by `until`.
+ * `do` after `while` and `for` belongs to the loop. Unbalanced
+ * tokens are left unmatched.
+ */
+static int
+tokens_match(const char *src, struct lua_tokens *tokens)
+{
+	size_t *stack = malloc(tokens->num * sizeof(*stack));
+	if (stack == NULL && tokens->num != 0)
+		return -1;
+	/* Loops, that have no `do` yet, are marked by SIZE_MAX match. */
+	char *loop_has_do = calloc(tokens->num + 1, 1);
+	if (loop_has_do == NULL) {
+		free(stack);
+		return -1;
+	}
+	size_t top = 0;
+	for (size_t i = 0; i < tokens->num; i++) {
+		struct lua_token *tok = &tokens->tokens[i];
+		const char *s = src + tok->offset;
+		if (tok->type == LUA_TOKEN_OPERATOR && tok->len == 1 &&
+		    (s[0] == '(' || s[0] == '{' || s[0] == '[')) {
+			stack[top++] = i;
+			continue;
+		}
+		if (tok->type == LUA_TOKEN_OPERATOR && tok->len == 1 &&
+		    (s[0] == ')' || s[0] == '}' || s[0] == ']')) {
+			char open = s[0] == ')' ? '(' : s[0] == '}' ? '{' : '[';
+			if (top > 0 &&
+			    src[tokens->tokens[stack[top - 1]].offset] == open) {
+				tokens->tokens[stack[--top]].match = i;
+			}
+			continue;
+		}
+		if (tok->type != LUA_TOKEN_KEYWORD)
+			continue;
+		if (token_is(src, tok, "do") && top > 0) {
+			size_t loop = stack[top - 1];
+			const struct lua_token *t = &tokens->tokens[loop];
+			if ((token_is(src, t, "while") ||
+			     token_is(src, t, "for")) && !loop_has_do[loop]) {
+				loop_has_do[loop] = 1;
+				continue;
+			}
+		}
+		if (token_is(src, tok, "function") || token_is(src, tok, "if") ||
+		    token_is(src, tok, "do") || token_is(src, tok, "while") ||
+		    token_is(src, tok, "for") || token_is(src, tok, "repeat")) {
+			stack[top++] = i;
+			continue;
+		}
+		if (top == 0)
+			continue;
+		const struct lua_token *open = &tokens->tokens[stack[top - 1]];
+		int is_repeat = token_is(src, open, "repeat");
+		int is_bracket = open->type == LUA_TOKEN_OPERATOR;
+		if ((token_is(src, tok, "end") && !is_repeat && !is_bracket) ||
+		    (token_is(src, tok, "until") && is_repeat))
+			tokens->tokens[stack[--top]].match = i;
+	}
+	free(loop_has_do);
+	free(stack);
+	return 0;
+}
+
+int
+lua_tokenize(const char *src, size_t size, struct lua_tokens *tokens)
+{
+	memset(tokens, 0, sizeof(*tokens));
+	size_t pos = 0;
+	while (pos < size) {
+		char c = src[pos];
+		if (c == ' ' || c == '\t' || c == '\r' || c == '\n' ||
+		    c == '\f' || c == '\v') {
+			pos++;
+			continue;
+		}
+		if (c == '-' && pos + 1 < size && src[pos + 1] == '-') {
+			pos += 2;
+			int level = long_bracket_level(src, size, pos);
+			if (level >= 0) {
+				pos = skip_long_bracket(src, size, pos, level);
+				continue;
+			}
+			while (pos < size && src[pos] != '\n' && src[pos] != '\r')
+				pos++;
+			continue;
+		}
+
+		size_t start = pos;
+		enum lua_token_type type;
+		if (isalpha((unsigned char)c) || c == '_') {
+			while (pos < size && is_name_char(src[pos]))
+				pos++;
+			type = is_one_of(src + start, pos - start, keywords,
+					 lengthof(keywords)) ?
+				LUA_TOKEN_KEYWORD : LUA_TOKEN_NAME;
+		} else if (isdigit((unsigned char)c) ||
+			   (c == '.' && pos + 1 < size &&
+			    isdigit((unsigned char)src[pos + 1]))) {
+			pos = skip_numeral(src, size, pos);
+			type = LUA_TOKEN_NUMBER;
+		} else if (c == '"' || c == '\'') {
+			pos = skip_short_string(src, size, pos);
+			type = LUA_TOKEN_STRING;
+		} else if (long_bracket_level(src, size, pos) >= 0) {
+			int level = long_bracket_level(src, size, pos);
+			pos = skip_long_bracket(src, size, pos, level);
+			type = LUA_TOKEN_STRING;
+		} else {
+			type = LUA_TOKEN_OTHER;
+			pos++;
+			for (size_t i = 0; i < lengthof(operators); i++) {
+				size_t len = strlen(operators[i]);
+				if (start + len <= size &&
+				    memcmp(src + start, operators[i], len) == 0) {
+					type = LUA_TOKEN_OPERATOR;
+					pos = start + len;
+					break;
+				}
+			}
+		}
+		if (tokens_push(tokens, type, start, pos - start) != 0) {
+			lua_tokens_destroy(tokens);
+			return -1;
+		}
+	}
+	if (tokens_match(src, tokens) != 0) {
+		lua_tokens_destroy(tokens);
+		return -1;
+	}
+	return 0;
+}
+
+void
+lua_tokens_destroy(struct lua_tokens *tokens)
+{
+	free(tokens->tokens);
+	memset(tokens, 0, sizeof(*tokens));
+}
+
+/* A buffer with a fixed capacity. */
+struct buf {
+	uint8_t *data;
+	size_t size;
+	size_t capacity;
+};
+
+static int
+buf_append(struct buf *buf, const void *data, size_t size)
+{
+	if (size > buf->capacity - buf->size)
+		return -1;
+	memcpy(buf->data + buf->size, data, size);
+	buf->size += size;
+	return 0;
+}
+
+/* Writes `src` with a range [begin, end) replaced by `text`. */
+static int
+replace_range(const char *src, size_t size, size_t begin, size_t end,
+	      const char *text, size_t text_len, struct buf *out)
+{
+	out->size = 0;
+	if (buf_append(out, src, begin) != 0 ||
+	    buf_append(out, text, text_len) != 0 ||
+	    buf_append(out, src + end, size - end) != 0)
+		return -1;
+	return 0;
+}
+
+/* Replaces a token by a text surrounded by spaces. */
+static int
+replace_token(const char *src, size_t size, const struct lua_token *tok,
+	      const char *text, struct buf *out)
+{
+	out->size = 0;
+	if (buf_append(out, src, tok->offset) != 0 ||
+	    buf_append(out, " ", 1) != 0 ||
+	    buf_append(out, text, strlen(text)) != 0 ||
+	    buf_append(out, " ", 1) != 0 ||
+	    buf_append(out, src + tok->offset + tok->len,
+		       size - tok->offset - tok->len) != 0)
+		return -1;
+	return 0;
+}
+
+typedef int (*token_filter)(const char *src, const struct lua_token *tok);
+
+/* Returns an index of a random token that passes a filter. */
+static size_t
+random_token(const char *src, const struct lua_tokens *tokens,
+	     token_filter filter, uint32_t *rng)
+{
+	size_t num = 0;
+	for (size_t i = 0; i < tokens->num; i++)
+		num += filter(src, &tokens->tokens[i]);
+	if (num == 0)
+		return SIZE_MAX;
+	size_t n = rng_next(rng) % num;
+	for (size_t i = 0; i < tokens->num; i++) {
+		if (filter(src, &tokens->tokens[i]) && n-- == 0)
+			return i;
+	}
+	return SIZE_MAX;
+}
+
+static int
+is_binary_operator(const char *src, const struct lua_token *tok)
+{
+	return (tok->type == LUA_TOKEN_OPERATOR ||
+		tok->type == LUA_TOKEN_KEYWORD) &&
+	       is_one_of(src + tok->offset, tok->len, binary_operators,
+			 lengthof(binary_operators));
+}
+
+static int
+is_name(const char *src, const struct lua_token *tok)
+{
+	return tok->type == LUA_TOKEN_NAME;
+}
+
+static int
+is_number(const char *src, const struct lua_token *tok)
+{
+	return tok->type == LUA_TOKEN_NUMBER;
+}
+
+static int
+is_string(const char *src, const struct lua_token *tok)
+{
+	return tok->type == LUA_TOKEN_STRING;
+}
+
+static int
+is_matched(const char *src, const struct lua_token *tok)
+{
+	return tok->match != SIZE_MAX;
+}
+
+/*
+ * Returns an end of a range opened by a token. The range of
+ * `repeat` includes a token after `until`, it is an approximation
+ * of the loop condition.
+ */
+static size_t
+range_end(const char *src, const struct lua_tokens *tokens, size_t idx)
+{
+	size_t last = tokens->tokens[idx].match;
+	if (token_is(src, &tokens->tokens[idx], "repeat") &&
+	    last + 1 < tokens->num)
+		last++;
+	return tokens->tokens[last].offset + tokens->tokens[last].len;
+}
+
+static int
+mutate_operator(const char *src, size_t size, const struct lua_tokens *tokens,
+		uint32_t *rng, struct buf *out)
+{
+	size_t idx = random_token(src, tokens, is_binary_operator, rng);
+	if (idx == SIZE_MAX)
+		return -1;
+	const char *op = binary_operators[rng_next(rng) %
+					  lengthof(binary_operators)];
+	return replace_token(src, size, &tokens->tokens[idx], op, out);
+}
+
+static int
+mutate_name(const char *src, size_t size, const struct lua_tokens *tokens,
+	    uint32_t *rng, struct buf *out)
+{
+	size_t idx = random_token(src, tokens, is_name, rng);
+	if (idx == SIZE_MAX)
+		return -1;
+	const struct lua_token *tok = &tokens->tokens[idx];
+	if (rng_next(rng) % 2 == 0) {
+		/* Another name used in the source. */
+		size_t other = random_token(src, tokens, is_name, rng);
+		const struct lua_token *o = &tokens->tokens[other];
+		return replace_range(src, size, tok->offset,
+				     tok->offset + tok->len, src + o->offset,
+				     o->len, out);
+	}
+	const char *name = names[rng_next(rng) % lengthof(names)];
+	return replace_token(src, size, tok, name, out);
+}
+
+static int
+mutate_number(const char *src, size_t size, const struct lua_tokens *tokens,
+	      uint32_t *rng, struct buf *out)
+{
+	size_t idx = random_token(src, tokens, is_number, rng);
+	if (idx == SIZE_MAX)
+		return -1;
+	const char *num = numbers[rng_next(rng) % lengthof(numbers)];
+	return replace_token(src, size, &tokens->tokens[idx], num, out);
+}
+
+static int
+mutate_string(const char *src, size_t size, const struct lua_tokens *tokens,
+	      uint32_t *rng, struct buf *out)
+{
+	size_t idx = random_token(src, tokens, is_string, rng);
+	if (idx == SIZE_MAX)
+		return -1;
+	const char *str = strings[rng_next(rng) % lengthof(strings)];
+	return replace_token(src, size, &tokens->tokens[idx], str, out);
+}
+
+/* Inserts a copy of a block or brackets after the original. */
+static int
+mutate_duplicate(const char *src, size_t size, const struct lua_tokens *tokens,
+		 uint32_t *rng, struct buf *out)
+{
+	size_t idx = random_token(src, tokens, is_matched, rng);
+	if (idx == SIZE_MAX)
+		return -1;
+	size_t begin = tokens->tokens[idx].offset;
+	size_t end = range_end(src, tokens, idx);
+	out->size = 0;
+	if (buf_append(out, src, end) != 0 ||
+	    buf_append(out, "\n", 1) != 0 ||
+	    buf_append(out, src + begin, end - begin) != 0 ||
+	    buf_append(out, src + end, size - end) != 0)
+		return -1;
+	return 0;
+}
+
+static int
+mutate_delete(const char *src, size_t size, const struct lua_tokens *tokens,
+	      uint32_t *rng, struct buf *out)
+{
+	size_t idx = random_token(src, tokens, is_matched, rng);
+	if (idx == SIZE_MAX)
+		return -1;
+	size_t begin = tokens->tokens[idx].offset;
+	size_t end = range_end(src, tokens, idx);
+	return replace_range(src, size, begin, end, "", 0, out);
+}
+
+typedef int (*token_mutation)(const char *src, size_t size,
+			      const struct lua_tokens *tokens,
+			      uint32_t *rng, struct buf *out);
+
+static const token_mutation mutations[] = {
+	mutate_operator,
+	mutate_name,
+	mutate_number,
+	mutate_string,
+	mutate_duplicate,
+	mutate_delete,
+};
+
+size_t
+lua_token_mutate(uint8_t *data, size_t size, size_t max_size,
+		 unsigned int seed)
+{
+	const char *src = (const char *)data;
+	struct lua_tokens tokens;
+	if (lua_tokenize(src, size, &tokens) != 0)
+		return 0;
+
+	struct buf out = { malloc(max_size), 0, max_size };
+	if (out.data == NULL) {
+		lua_tokens_destroy(&tokens);
+		return 0;
+	}
+	uint32_t rng;
+	rng_init(&rng, seed);
+	size_t new_size = 0;
+	for (int i = 0; i < MAX_ATTEMPTS; i++) {
+		token_mutation mutate =
+			mutations[rng_next(&rng) % lengthof(mutations)];
+		/* An empty result is not allowed by libFuzzer. */
+		if (mutate(src, size, &tokens, &rng, &out) == 0 &&
+		    out.size != 0) {
+			memcpy(data, out.data, out.size);
+			new_size = out.size;
+			break;
+		}
+	}
+	free(out.data);
+	lua_tokens_destroy(&tokens);
+	return new_size;
+}
+
+/* Returns a kind of a range: a bracket or 'b' for blocks. */
+static char
+range_kind(const char *src, const struct lua_token *tok)
+{
+	return tok->type == LUA_TOKEN_OPERATOR ? src[tok->offset] : 'b';
+}
+
+size_t
+lua_token_crossover(const uint8_t *data1, size_t size1,
+		    const uint8_t *data2, size_t size2,
+		    uint8_t *out, size_t max_out_size, unsigned int seed)
+{
+	const char *src1 = (const char *)data1;
+	const char *src2 = (const char *)data2;
+	struct lua_tokens tokens1, tokens2;
+	if (lua_tokenize(src1, size1, &tokens1) != 0)
+		return 0;
+	if (lua_tokenize(src2, size2, &tokens2) != 0) {
+		lua_tokens_destroy(&tokens1);
+		return 0;
+	}
+
+	struct buf buf = { out, 0, max_out_size };
+	uint32_t rng;
+	rng_init(&rng, seed);
+	size_t new_size = 0;
+	for (int i = 0; i < MAX_ATTEMPTS; i++) {
+		size_t idx1 = random_token(src1, &tokens1, is_matched, &rng);
+		size_t idx2 = random_token(src2, &tokens2, is_matched, &rng);
+		if (idx1 == SIZE_MAX || idx2 == SIZE_MAX)
+			break;
+		if (range_kind(src1, &tokens1.tokens[idx1]) !=
+		    range_kind(src2, &tokens2.tokens[idx2]))
+			continue;
+		size_t begin2 = tokens2.tokens[idx2].offset;
+		size_t end2 = range_end(src2, &tokens2, idx2);
+		if (replace_range(src1, size1, tokens1.tokens[idx1].offset,
+				  range_end(src1, &tokens1, idx1),
+				  src2 + begin2, end2 - begin2, &buf) == 0 &&
+		    buf.size != 0) {
+			new_size = buf.size;
+			break;
+		}
+	}
+	lua_tokens_destroy(&tokens1);
+	lua_tokens_destroy(&tokens2);
+	return new_size;
+}
+
+/*
+ * libFuzzer's byte-level mutation, it is absent when the library
+ * is used without libFuzzer.
+ */
+size_t
+LLVMFuzzerMutate(uint8_t *data, size_t size, size_t max_size)
+	__attribute__((weak));
+
+size_t
+LLVMFuzzerCustomMutator(uint8_t *data, size_t size, size_t max_size,
+			unsigned int seed)
+{
+	/*
+	 * Byte-level mutations are used sometimes for producing
+	 * tokens, that are absent in a corpus.
+	 */
+	if (LLVMFuzzerMutate != NULL && seed % 4 == 0)
+		return LLVMFuzzerMutate(data, size, max_size);
+	size_t new_size = lua_token_mutate(data, size, max_size, seed);
+	if (new_size != 0)
+		return new_size;
+	if (LLVMFuzzerMutate != NULL)
+		return LLVMFuzzerMutate(data, size, max_size);
+	return size;
+}
+
+size_t
+LLVMFuzzerCustomCrossOver(const uint8_t *data1, size_t size1,
+			  const uint8_t *data2, size_t size2,
+			  uint8_t *out, size_t max_out_size,
+			  unsigned int seed)
+{
+	return lua_token_crossover(data1, size1, data2, size2, out,
+				   max_out_size, seed);
+}
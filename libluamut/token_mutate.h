@@ -0,0 +1,88 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright 2025, Sergey Bronnikov
+ */
+
+/*
+ * Structure-aware mutator for Lua source code. An input is split
+ * into tokens by a lexer that follows the rules of llex.c, and
+ * mutations replace tokens and balanced token ranges, so most
+ * mutants pass the lexer and reach the parser.
+ */
+
+#ifndef TOKEN_MUTATE_H
+#define TOKEN_MUTATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum lua_token_type {
+	LUA_TOKEN_NAME,
+	LUA_TOKEN_KEYWORD,
+	LUA_TOKEN_NUMBER,
+	LUA_TOKEN_STRING,
+	LUA_TOKEN_OPERATOR,
+	/* A byte that does not start any token. */
+	LUA_TOKEN_OTHER,
+};
+
+struct lua_token {
+	enum lua_token_type type;
+	/* A position of the token in a source. */
+	size_t offset;
+	size_t len;
+	/*
+	 * An index of a token that closes a block or brackets opened
+	 * by the token, or SIZE_MAX.
+	 */
+	size_t match;
+};
+
+struct lua_tokens {
+	struct lua_token *tokens;
+	size_t num;
+	size_t capacity;
+};
+
+/*
+ * Splits a source into tokens, whitespaces and comments are
+ * skipped. An unfinished string or a long comment lasts until the
+ * end of the source. Returns 0 on success and -1 on a memory
+ * allocation error. Tokens must be freed by lua_tokens_destroy().
+ */
+int
+lua_tokenize(const char *src, size_t size, struct lua_tokens *tokens);
+
+void
+lua_tokens_destroy(struct lua_tokens *tokens);
+
+/*
+ * Mutates Lua source code in place, returns a new size that is
+ * not greater than `max_size` or 0, when there is no mutation,
+ * that fits `max_size`. The same seed gives the same mutation.
+ */
+size_t
+lua_token_mutate(uint8_t *data, size_t size, size_t max_size,
+		 unsigned int seed);
+
+/*
+ * Replaces a block or brackets in the first source with a block
+ * or brackets of the same kind from the second source. Returns
+ * a size of the result placed to `out` or 0, when there is no
+ * crossover, that fits `max_out_size`.
+ */
+size_t
+lua_token_crossover(const uint8_t *data1, size_t size1,
+		    const uint8_t *data2, size_t size2,
+		    uint8_t *out, size_t max_out_size, unsigned int seed);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* TOKEN_MUTATE_H */
@@ -0,0 +1,166 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright 2025, Sergey Bronnikov.
+ */
+
+/**
+ * The driver runs a libFuzzer-compatible test function
+ * `LLVMFuzzerTestOneInput()` in AFL++ persistent mode with
+ * shared memory testcase delivery, see [1]. The fork server is
+ * started before `LLVMFuzzerInitialize()`, so state setup is
+ * performed in a forked process.
+ *
+ * When files or directories are passed in command-line
+ * arguments, every file is executed once and the driver exits,
+ * this mode is used for corpus replay.
+ *
+ * 1. https://github.com/AFLplusplus/AFLplusplus/blob/stable/instrumentation/README.persistent_mode.md
+ */
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Fallback definitions for building the driver without AFL++
+ * compiler wrappers, testcases are read from stdin.
+ */
+#ifndef __AFL_FUZZ_TESTCASE_LEN
+static ssize_t fuzz_len;
+static unsigned char fuzz_buf[1024000];
+#define __AFL_FUZZ_TESTCASE_LEN fuzz_len
+#define __AFL_FUZZ_TESTCASE_BUF fuzz_buf
+#define __AFL_FUZZ_INIT()
+#define __AFL_LOOP(x) \
+	((fuzz_len = read(0, fuzz_buf, sizeof(fuzz_buf))) > 0 ? 1 : 0)
+#define __AFL_INIT() do {} while (0)
+#endif /* __AFL_FUZZ_TESTCASE_LEN */
+
+/* Number of inputs executed by a process before re-forking. */
+#define AFL_LOOP_COUNT 10000
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+__attribute__((weak)) int
+LLVMFuzzerInitialize(int *argc, char ***argv);
+
+/*
+ * libprotobuf-mutator's custom mutator refers to a libFuzzer
+ * function, AFL++ never calls custom mutators defined in a test.
+ */
+__attribute__((weak)) size_t
+LLVMFuzzerMutate(uint8_t *data, size_t size, size_t max_size)
+{
+	return size;
+}
+
+__AFL_FUZZ_INIT();
+
+/*
+ * The testcase is copied to a buffer of exact size, so
+ * AddressSanitizer detects reads past the input end.
+ */
+static void
+run_input(const uint8_t *data, size_t size)
+{
+	uint8_t *copy = (uint8_t *)malloc(size);
+	if (size != 0 && copy == NULL) {
+		perror("malloc");
+		abort();
+	}
+	if (size != 0)
+		memcpy(copy, data, size);
+	LLVMFuzzerTestOneInput(copy, size);
+	free(copy);
+}
+
+static int
+run_file(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) {
+		fprintf(stderr, "Unable to open '%s'.\n", path);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	if (size < 0 || fseek(f, 0, SEEK_SET) != 0) {
+		fprintf(stderr, "Unable to get a size of '%s'.\n", path);
+		fclose(f);
+		return -1;
+	}
+	uint8_t *buf = (uint8_t *)malloc(size > 0 ? size : 1);
+	if (buf == NULL) {
+		fclose(f);
+		return -1;
+	}
+	size_t n = fread(buf, 1, size, f);
+	fclose(f);
+	run_input(buf, n);
+	free(buf);
+	return 0;
+}
+
+static int
+run_path(const char *path)
+{
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		fprintf(stderr, "Unable to stat '%s'.\n", path);
+		return -1;
+	}
+	if (!S_ISDIR(st.st_mode))
+		return run_file(path);
+
+	DIR *dir = opendir(path);
+	if (dir == NULL)
+		return -1;
+	int rc = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.')
+			continue;
+		char file_path[PATH_MAX];
+		snprintf(file_path, sizeof(file_path), "%s/%s", path,
+			 entry->d_name);
+		if (run_path(file_path) != 0)
+			rc = -1;
+	}
+	closedir(dir);
+	return rc;
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc > 1) {
+		if (LLVMFuzzerInitialize)
+			LLVMFuzzerInitialize(&argc, &argv);
+		int rc = 0;
+		for (int i = 1; i < argc; i++) {
+			if (run_path(argv[i]) != 0)
+				rc = 1;
+		}
+		return rc;
+	}
+
+	__AFL_INIT();
+	if (LLVMFuzzerInitialize)
+		LLVMFuzzerInitialize(&argc, &argv);
+
+	/* Must be obtained after __AFL_INIT(). */
+	unsigned char *buf = __AFL_FUZZ_TESTCASE_BUF;
+	while (__AFL_LOOP(AFL_LOOP_COUNT)) {
+		size_t len = __AFL_FUZZ_TESTCASE_LEN;
+		run_input(buf, len);
+	}
+
+	return 0;
+}
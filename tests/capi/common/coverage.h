@@ -0,0 +1,46 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright 2025, Sergey Bronnikov.
+ */
+
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* defined(__cplusplus) */
+
+/*
+ * Options `-fsanitize=fuzzer` and `-fsanitize=fuzzer-no-link`
+ * place inline 8-bit counters, one counter per instrumented edge,
+ * to a section `__sancov_cntrs`. The linker defines symbols with
+ * section bounds, these symbols are NULL when nothing is
+ * instrumented. See https://clang.llvm.org/docs/SanitizerCoverage.html.
+ */
+extern uint8_t __start___sancov_cntrs[] __attribute__((weak));
+extern uint8_t __stop___sancov_cntrs[] __attribute__((weak));
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* defined(__cplusplus) */
+
+static inline uint8_t *
+cov_counters(void)
+{
+	return __start___sancov_cntrs;
+}
+
+static inline size_t
+cov_counters_size(void)
+{
+	if (__start___sancov_cntrs == NULL ||
+	    __stop___sancov_cntrs == NULL)
+		return 0;
+	return (size_t)(__stop___sancov_cntrs - __start___sancov_cntrs);
+}
+
+#endif /* COVERAGE_H */
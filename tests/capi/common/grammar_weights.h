@@ -0,0 +1,383 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright 2025, Sergey Bronnikov.
+ */
+
+/**
+ * Adaptive weighting of grammar productions in protobuf-based
+ * tests. A production is a field of a `oneof` in a grammar, e.g.
+ * `lua_grammar.Statement.ifstat`. For every production the number
+ * of executed inputs, that contain the production, and the number
+ * of inputs, that reached new coverage, are counted. An input
+ * reaches new coverage, when it hits an edge, that was not hit by
+ * previous inputs, see coverage.h.
+ *
+ * Statistics are used by a libprotobuf-mutator post-processor,
+ * that is registered for every message with a `oneof`: after
+ * a mutation one of GRAMMAR_WEIGHTS_RESAMPLE_RATE messages gets
+ * a production sampled with a probability proportional to its
+ * coverage yield, so mutation effort shifts toward productive
+ * constructs.
+ *
+ * Weighting is enabled by the environment variable
+ * LUA_FUZZER_GRAMMAR_WEIGHTS, a value is a path to a file with
+ * statistics, that is loaded on start and saved periodically and
+ * on exit, so statistics are accumulated by consequent runs. Every
+ * line of the file contains a production name, a number of
+ * executions and a number of executions with new coverage
+ * separated by tabs. Edges hit by previous runs are saved to
+ * a file with a suffix ".edges", so inputs replayed from a corpus
+ * on a restart do not count as new coverage. The edges are
+ * discarded, when a number of edges is changed, e.g. a test is
+ * rebuilt.
+ */
+
+#ifndef GRAMMAR_WEIGHTS_H
+#define GRAMMAR_WEIGHTS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+#include <libprotobuf-mutator/src/libfuzzer/libfuzzer_macro.h>
+
+#include "coverage.h"
+
+/* Statistics are saved every GRAMMAR_WEIGHTS_SAVE_PERIOD inputs. */
+#define GRAMMAR_WEIGHTS_SAVE_PERIOD 10000
+/* Weights are not used until statistics are collected. */
+#define GRAMMAR_WEIGHTS_MIN_INPUTS 1000
+#define GRAMMAR_WEIGHTS_RESAMPLE_RATE 128
+/* A prior number of executions, it smooths weights of rare productions. */
+#define GRAMMAR_WEIGHTS_PRIOR 100
+
+struct production_stats {
+	uint64_t num_execs;
+	uint64_t num_new_cov;
+};
+
+struct grammar_weights {
+	std::mutex mutex;
+	std::string path;
+	/* Statistics by a full name of a production. */
+	std::unordered_map<std::string, struct production_stats> stats;
+	/* Edges hit by previous inputs. */
+	std::vector<uint8_t> seen_edges;
+	uint64_t num_inputs;
+};
+
+static inline void
+grammar_weights_load(struct grammar_weights *w)
+{
+	FILE *f = fopen(w->path.c_str(), "r");
+	if (f == NULL)
+		return;
+	char name[256];
+	unsigned long long num_execs, num_new_cov;
+	while (fscanf(f, "%255s %llu %llu", name, &num_execs,
+		      &num_new_cov) == 3) {
+		struct production_stats *s = &w->stats[name];
+		s->num_execs = num_execs;
+		s->num_new_cov = num_new_cov;
+	}
+	fclose(f);
+
+	f = fopen((w->path + ".edges").c_str(), "rb");
+	if (f == NULL)
+		return;
+	if (fseek(f, 0, SEEK_END) == 0) {
+		long size = ftell(f);
+		if (size > 0 && (size_t)size == cov_counters_size() &&
+		    fseek(f, 0, SEEK_SET) == 0) {
+			w->seen_edges.resize(size);
+			if (fread(w->seen_edges.data(), 1, size, f) !=
+			    (size_t)size)
+				w->seen_edges.clear();
+		}
+	}
+	fclose(f);
+}
+
+static inline void
+grammar_weights_write(const std::string &path, const std::string &data)
+{
+	std::string tmp_path = path + ".tmp";
+	FILE *f = fopen(tmp_path.c_str(), "wb");
+	if (f == NULL)
+		return;
+	size_t n = fwrite(data.data(), 1, data.size(), f);
+	if (fclose(f) != 0 || n != data.size()) {
+		remove(tmp_path.c_str());
+		return;
+	}
+	rename(tmp_path.c_str(), path.c_str());
+}
+
+static inline void
+grammar_weights_save(struct grammar_weights *w)
+{
+	std::string stats;
+	for (const auto &it : w->stats) {
+		stats += it.first + "\t" +
+			 std::to_string(it.second.num_execs) + "\t" +
+			 std::to_string(it.second.num_new_cov) + "\n";
+	}
+	grammar_weights_write(w->path, stats);
+	grammar_weights_write(w->path + ".edges",
+			      std::string(w->seen_edges.begin(),
+					  w->seen_edges.end()));
+}
+
+static void grammar_weights_save_at_exit(void);
+
+/* Returns NULL when weighting is disabled. */
+static inline struct grammar_weights *
+grammar_weights(void)
+{
+	static struct grammar_weights *weights = [] {
+		const char *path = getenv("LUA_FUZZER_GRAMMAR_WEIGHTS");
+		if (path == NULL)
+			return (struct grammar_weights *)NULL;
+		struct grammar_weights *w = new struct grammar_weights;
+		w->path = path;
+		w->num_inputs = 0;
+		grammar_weights_load(w);
+		atexit(grammar_weights_save_at_exit);
+		return w;
+	}();
+	return weights;
+}
+
+static void
+grammar_weights_save_at_exit(void)
+{
+	struct grammar_weights *w = grammar_weights();
+	std::lock_guard<std::mutex> lock(w->mutex);
+	grammar_weights_save(w);
+}
+
+static inline double
+grammar_weights_weight(const struct grammar_weights *w,
+		       const google::protobuf::FieldDescriptor *field)
+{
+	auto it = w->stats.find(field->full_name());
+	if (it == w->stats.end())
+		return 1.0 / GRAMMAR_WEIGHTS_PRIOR;
+	return (it->second.num_new_cov + 1.0) /
+	       (it->second.num_execs + GRAMMAR_WEIGHTS_PRIOR);
+}
+
+static inline void
+grammar_weights_collect(const google::protobuf::Message &message,
+			std::unordered_set<const google::protobuf::FieldDescriptor *>
+			*productions)
+{
+	using google::protobuf::FieldDescriptor;
+
+	const google::protobuf::Descriptor *descriptor =
+		message.GetDescriptor();
+	const google::protobuf::Reflection *reflection =
+		message.GetReflection();
+	for (int i = 0; i < descriptor->oneof_decl_count(); i++) {
+		const FieldDescriptor *field =
+			reflection->GetOneofFieldDescriptor(message,
+				descriptor->oneof_decl(i));
+		if (field != NULL)
+			productions->insert(field);
+	}
+	std::vector<const FieldDescriptor *> fields;
+	reflection->ListFields(message, &fields);
+	for (const FieldDescriptor *field : fields) {
+		if (field->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE)
+			continue;
+		if (!field->is_repeated()) {
+			grammar_weights_collect(
+				reflection->GetMessage(message, field),
+				productions);
+			continue;
+		}
+		int size = reflection->FieldSize(message, field);
+		for (int i = 0; i < size; i++) {
+			grammar_weights_collect(
+				reflection->GetRepeatedMessage(message, field, i),
+				productions);
+		}
+	}
+}
+
+/* Updates statistics, when an input is executed. */
+static inline void
+grammar_weights_update(const google::protobuf::Message &message)
+{
+	struct grammar_weights *w = grammar_weights();
+	if (w == NULL)
+		return;
+
+	std::unordered_set<const google::protobuf::FieldDescriptor *>
+		productions;
+	grammar_weights_collect(message, &productions);
+
+	std::lock_guard<std::mutex> lock(w->mutex);
+	const uint8_t *counters = cov_counters();
+	size_t num_counters = cov_counters_size();
+	if (w->seen_edges.size() != num_counters)
+		w->seen_edges.assign(num_counters, 0);
+	bool is_new_cov = false;
+	for (size_t i = 0; i < num_counters; i++) {
+		if (counters[i] != 0 && w->seen_edges[i] == 0) {
+			w->seen_edges[i] = 1;
+			is_new_cov = true;
+		}
+	}
+	for (const auto *field : productions) {
+		struct production_stats *s = &w->stats[field->full_name()];
+		s->num_execs++;
+		s->num_new_cov += is_new_cov;
+	}
+	if (++w->num_inputs % GRAMMAR_WEIGHTS_SAVE_PERIOD == 0)
+		grammar_weights_save(w);
+}
+
+/*
+ * Sets a field of a `oneof` to a default value. A new nested
+ * message is empty, it is not initialized, that is allowed by
+ * the text format of libprotobuf-mutator, missed fields are
+ * added by next mutations.
+ */
+static inline void
+grammar_weights_set_field(google::protobuf::Message *message,
+			  const google::protobuf::FieldDescriptor *field)
+{
+	using google::protobuf::FieldDescriptor;
+
+	const google::protobuf::Reflection *reflection =
+		message->GetReflection();
+	switch (field->cpp_type()) {
+	case FieldDescriptor::CPPTYPE_MESSAGE:
+		reflection->MutableMessage(message, field);
+		break;
+	case FieldDescriptor::CPPTYPE_STRING:
+		reflection->SetString(message, field, "");
+		break;
+	case FieldDescriptor::CPPTYPE_INT32:
+		reflection->SetInt32(message, field, 0);
+		break;
+	case FieldDescriptor::CPPTYPE_INT64:
+		reflection->SetInt64(message, field, 0);
+		break;
+	case FieldDescriptor::CPPTYPE_UINT32:
+		reflection->SetUInt32(message, field, 0);
+		break;
+	case FieldDescriptor::CPPTYPE_UINT64:
+		reflection->SetUInt64(message, field, 0);
+		break;
+	case FieldDescriptor::CPPTYPE_DOUBLE:
+		reflection->SetDouble(message, field, 0);
+		break;
+	case FieldDescriptor::CPPTYPE_FLOAT:
+		reflection->SetFloat(message, field, 0);
+		break;
+	case FieldDescriptor::CPPTYPE_BOOL:
+		reflection->SetBool(message, field, false);
+		break;
+	case FieldDescriptor::CPPTYPE_ENUM:
+		reflection->SetEnum(message, field,
+				    field->enum_type()->value(0));
+		break;
+	}
+}
+
+static void
+grammar_weights_post_process(google::protobuf::Message *message,
+			     unsigned int seed)
+{
+	using google::protobuf::FieldDescriptor;
+
+	if (seed % GRAMMAR_WEIGHTS_RESAMPLE_RATE != 0)
+		return;
+	struct grammar_weights *w = grammar_weights();
+	std::lock_guard<std::mutex> lock(w->mutex);
+	if (w->num_inputs < GRAMMAR_WEIGHTS_MIN_INPUTS)
+		return;
+
+	std::minstd_rand rng(seed);
+	const google::protobuf::Descriptor *descriptor =
+		message->GetDescriptor();
+	const google::protobuf::Reflection *reflection =
+		message->GetReflection();
+	for (int i = 0; i < descriptor->oneof_decl_count(); i++) {
+		const google::protobuf::OneofDescriptor *oneof =
+			descriptor->oneof_decl(i);
+		const FieldDescriptor *current =
+			reflection->GetOneofFieldDescriptor(*message, oneof);
+		if (current == NULL)
+			continue;
+		std::vector<double> weights;
+		for (int j = 0; j < oneof->field_count(); j++)
+			weights.push_back(grammar_weights_weight(w,
+				oneof->field(j)));
+		std::discrete_distribution<int> dist(weights.begin(),
+						     weights.end());
+		const FieldDescriptor *field = oneof->field(dist(rng));
+		if (field != current)
+			grammar_weights_set_field(message, field);
+	}
+}
+
+/*
+ * Registers the post-processor for every message with a `oneof`,
+ * that is reachable from a root message. Returns true, when
+ * weighting is enabled.
+ */
+static inline bool
+grammar_weights_register(const google::protobuf::Descriptor *root)
+{
+	if (grammar_weights() == NULL)
+		return false;
+	std::vector<const google::protobuf::Descriptor *> stack = { root };
+	std::unordered_set<const google::protobuf::Descriptor *> visited;
+	while (!stack.empty()) {
+		const google::protobuf::Descriptor *descriptor = stack.back();
+		stack.pop_back();
+		if (!visited.insert(descriptor).second)
+			continue;
+		if (descriptor->oneof_decl_count() != 0)
+			protobuf_mutator::libfuzzer::RegisterPostProcessor(
+				descriptor, grammar_weights_post_process);
+		for (int i = 0; i < descriptor->field_count(); i++) {
+			const google::protobuf::Descriptor *type =
+				descriptor->field(i)->message_type();
+			if (type != NULL)
+				stack.push_back(type);
+		}
+	}
+	return true;
+}
+
+/*
+ * Updates statistics, when a test function returns, an object
+ * should be created at the beginning of the function.
+ */
+struct grammar_weights_tracker {
+	const google::protobuf::Message &message;
+
+	explicit grammar_weights_tracker(const google::protobuf::Message &m)
+		: message(m) {}
+
+	~grammar_weights_tracker()
+	{
+		grammar_weights_update(message);
+	}
+};
+
+#endif /* GRAMMAR_WEIGHTS_H */
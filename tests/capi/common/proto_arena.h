@@ -0,0 +1,210 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright 2025, Sergey Bronnikov.
+ */
+
+/**
+ * DEFINE_ARENA_PROTO_FUZZER is a replacement of
+ * DEFINE_PROTO_FUZZER from libprotobuf-mutator, that decodes,
+ * mutates and crosses over messages allocated on a thread-local
+ * protobuf arena. The arena is reset after every call, so nested
+ * messages are allocated by a pointer bump in a reused memory block
+ * instead of thousands of small heap allocations and frees per
+ * input.
+ *
+ * The arena is disabled by the environment variable
+ * LUA_FUZZER_NO_ARENA, it allows to compare exec/s and a number of
+ * heap allocations made during decoding of a message with and
+ * without the arena, see proto_arena_last_allocs(). Allocations are
+ * counted by sanitizer malloc hooks, so they are counted in builds
+ * with sanitizers only.
+ */
+
+#ifndef PROTO_ARENA_H
+#define PROTO_ARENA_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <memory>
+
+#include <google/protobuf/arena.h>
+#include <google/protobuf/message.h>
+#include <libprotobuf-mutator/src/libfuzzer/libfuzzer_macro.h>
+
+/* The block is reused by every input. */
+#define PROTO_ARENA_INITIAL_BLOCK_SIZE (1024 * 1024)
+/* Blocks allocated after the initial block is exhausted. */
+#define PROTO_ARENA_BLOCK_SIZE (256 * 1024)
+
+extern "C" int
+__sanitizer_install_malloc_and_free_hooks(
+	void (*malloc_hook)(const volatile void *, size_t),
+	void (*free_hook)(const volatile void *)) __attribute__((weak));
+
+static size_t proto_arena_allocs;
+static thread_local size_t proto_arena_decode_allocs;
+/* A message mutated or crossed over by libprotobuf-mutator. */
+static thread_local const google::protobuf::Message *proto_arena_root;
+
+static void
+proto_arena_malloc_hook(const volatile void *ptr, size_t size)
+{
+	(void)ptr;
+	(void)size;
+	__atomic_add_fetch(&proto_arena_allocs, 1, __ATOMIC_RELAXED);
+}
+
+static void
+proto_arena_free_hook(const volatile void *ptr)
+{
+	(void)ptr;
+}
+
+static inline size_t
+proto_arena_num_allocs(void)
+{
+	static bool is_installed = [] {
+		if (__sanitizer_install_malloc_and_free_hooks == NULL)
+			return false;
+		return __sanitizer_install_malloc_and_free_hooks(
+			proto_arena_malloc_hook, proto_arena_free_hook) != 0;
+	}();
+	(void)is_installed;
+	return __atomic_load_n(&proto_arena_allocs, __ATOMIC_RELAXED);
+}
+
+static inline bool
+proto_arena_is_enabled(void)
+{
+	static const bool is_enabled = getenv("LUA_FUZZER_NO_ARENA") == NULL;
+	return is_enabled;
+}
+
+/* Returns NULL when the arena is disabled. */
+static inline google::protobuf::Arena *
+proto_arena(void)
+{
+	if (!proto_arena_is_enabled())
+		return NULL;
+	/*
+	 * The block is owned by a thread, it is destroyed after the
+	 * arena, that is constructed later.
+	 */
+	static thread_local std::unique_ptr<char[]> initial_block(
+		new char[PROTO_ARENA_INITIAL_BLOCK_SIZE]);
+	static thread_local google::protobuf::Arena arena([] {
+		google::protobuf::ArenaOptions options;
+		options.initial_block = initial_block.get();
+		options.initial_block_size = PROTO_ARENA_INITIAL_BLOCK_SIZE;
+		options.start_block_size = PROTO_ARENA_BLOCK_SIZE;
+		options.max_block_size = PROTO_ARENA_BLOCK_SIZE;
+		return options;
+	}());
+	return &arena;
+}
+
+template <class Proto>
+static inline Proto *
+proto_arena_new(void)
+{
+	return google::protobuf::Arena::CreateMessage<Proto>(proto_arena());
+}
+
+/*
+ * Frees a message allocated on a heap and all messages allocated
+ * on the arena except the initial block.
+ */
+static inline void
+proto_arena_free(google::protobuf::Message *message)
+{
+	if (message->GetArena() == NULL)
+		delete message;
+}
+
+static inline void
+proto_arena_reset(void)
+{
+	google::protobuf::Arena *arena = proto_arena();
+	if (arena != NULL)
+		arena->Reset();
+}
+
+/*
+ * Returns true, when a message is a root message mutated or
+ * crossed over by libprotobuf-mutator. Post-processors are called
+ * for nested messages before their parents, a post-processor
+ * registered for a message type, that is nested in itself, uses
+ * it to process a whole message once.
+ */
+static inline bool
+proto_arena_is_root(const google::protobuf::Message *message)
+{
+	return message == proto_arena_root;
+}
+
+/*
+ * Returns a number of heap allocations made by decoding of the
+ * last input.
+ */
+static inline size_t
+proto_arena_last_allocs(void)
+{
+	return proto_arena_decode_allocs;
+}
+
+#define DEFINE_ARENA_PROTO_FUZZER(Proto, arg)				\
+static void TestOneInputProto(const Proto &arg);			\
+									\
+extern "C" size_t							\
+LLVMFuzzerCustomMutator(uint8_t *data, size_t size, size_t max_size,	\
+			unsigned int seed)				\
+{									\
+	Proto *input = proto_arena_new<Proto>();			\
+	proto_arena_root = input;					\
+	size_t res = protobuf_mutator::libfuzzer::CustomProtoMutator(	\
+		false, data, size, max_size, seed, input);		\
+	proto_arena_root = NULL;					\
+	proto_arena_free(input);					\
+	proto_arena_reset();						\
+	return res;							\
+}									\
+									\
+extern "C" size_t							\
+LLVMFuzzerCustomCrossOver(const uint8_t *data1, size_t size1,		\
+			  const uint8_t *data2, size_t size2,		\
+			  uint8_t *out, size_t max_out_size,		\
+			  unsigned int seed)				\
+{									\
+	Proto *input1 = proto_arena_new<Proto>();			\
+	Proto *input2 = proto_arena_new<Proto>();			\
+	proto_arena_root = input1;					\
+	size_t res = protobuf_mutator::libfuzzer::CustomProtoCrossOver(	\
+		false, data1, size1, data2, size2, out, max_out_size,	\
+		seed, input1, input2);					\
+	proto_arena_root = NULL;					\
+	proto_arena_free(input1);					\
+	proto_arena_free(input2);					\
+	proto_arena_reset();						\
+	return res;							\
+}									\
+									\
+extern "C" int								\
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)		\
+{									\
+	size_t num_allocs = proto_arena_num_allocs();			\
+	Proto *input = proto_arena_new<Proto>();			\
+	bool is_loaded = protobuf_mutator::libfuzzer::LoadProtoInput(	\
+		false, data, size, input);				\
+	proto_arena_decode_allocs = proto_arena_num_allocs() - num_allocs; \
+	if (is_loaded)							\
+		TestOneInputProto(*input);				\
+	proto_arena_free(input);					\
+	proto_arena_reset();						\
+	return 0;							\
+}									\
+									\
+static void TestOneInputProto(const Proto &arg)
+
+#endif /* PROTO_ARENA_H */
@@ -0,0 +1,288 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright 2025, Sergey Bronnikov.
+ */
+
+/**
+ * The driver replays a corpus with a libFuzzer-compatible test
+ * function `LLVMFuzzerTestOneInput()` in several threads, every
+ * test input creates its own Lua state. Lua states are
+ * independent, so a throughput is expected to grow linearly with
+ * a number of threads, otherwise there is a shared state in a
+ * Lua runtime or in a test. Built with ThreadSanitizer
+ * (ENABLE_TSAN), the driver reports data races on such state.
+ *
+ * Usage: <test>_replay [-j threads] [-n rounds] path...
+ *
+ * Without `-j` the corpus is replayed with 1, 2, 4, ... threads
+ * up to a number of online CPUs, a line with throughput is
+ * printed for every number of threads.
+ */
+
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+__attribute__((weak)) int
+LLVMFuzzerInitialize(int *argc, char ***argv);
+
+struct input {
+	uint8_t *data;
+	size_t size;
+};
+
+struct corpus {
+	struct input *inputs;
+	size_t num_inputs;
+	size_t capacity;
+};
+
+struct replay {
+	const struct corpus *corpus;
+	/* Total number of test inputs to execute. */
+	size_t num_execs;
+	/* Index of the next test input, shared by all threads. */
+	size_t next;
+};
+
+static int
+corpus_add_file(struct corpus *corpus, const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) {
+		fprintf(stderr, "Unable to open '%s'.\n", path);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	if (size < 0 || fseek(f, 0, SEEK_SET) != 0) {
+		fprintf(stderr, "Unable to get a size of '%s'.\n", path);
+		fclose(f);
+		return -1;
+	}
+	uint8_t *buf = (uint8_t *)malloc(size > 0 ? size : 1);
+	if (buf == NULL) {
+		fclose(f);
+		return -1;
+	}
+	size_t n = fread(buf, 1, size, f);
+	fclose(f);
+
+	if (corpus->num_inputs == corpus->capacity) {
+		size_t capacity = corpus->capacity ? corpus->capacity * 2 : 64;
+		struct input *inputs = (struct input *)realloc(corpus->inputs,
+			capacity * sizeof(*inputs));
+		if (inputs == NULL) {
+			free(buf);
+			return -1;
+		}
+		corpus->inputs = inputs;
+		corpus->capacity = capacity;
+	}
+	corpus->inputs[corpus->num_inputs].data = buf;
+	corpus->inputs[corpus->num_inputs].size = n;
+	corpus->num_inputs++;
+	return 0;
+}
+
+static int
+corpus_add_path(struct corpus *corpus, const char *path)
+{
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		fprintf(stderr, "Unable to stat '%s'.\n", path);
+		return -1;
+	}
+	if (!S_ISDIR(st.st_mode))
+		return corpus_add_file(corpus, path);
+
+	DIR *dir = opendir(path);
+	if (dir == NULL)
+		return -1;
+	int rc = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.')
+			continue;
+		char file_path[PATH_MAX];
+		snprintf(file_path, sizeof(file_path), "%s/%s", path,
+			 entry->d_name);
+		if (corpus_add_path(corpus, file_path) != 0)
+			rc = -1;
+	}
+	closedir(dir);
+	return rc;
+}
+
+static void
+corpus_free(struct corpus *corpus)
+{
+	for (size_t i = 0; i < corpus->num_inputs; i++)
+		free(corpus->inputs[i].data);
+	free(corpus->inputs);
+}
+
+/*
+ * The testcase is copied to a buffer of exact size, so
+ * sanitizers detect reads past the input end.
+ */
+static void
+run_input(const struct input *input)
+{
+	uint8_t *copy = (uint8_t *)malloc(input->size);
+	if (input->size != 0 && copy == NULL) {
+		perror("malloc");
+		abort();
+	}
+	if (input->size != 0)
+		memcpy(copy, input->data, input->size);
+	LLVMFuzzerTestOneInput(copy, input->size);
+	free(copy);
+}
+
+static void *
+replay_worker(void *arg)
+{
+	struct replay *replay = (struct replay *)arg;
+	const struct corpus *corpus = replay->corpus;
+	for (;;) {
+		size_t idx = __atomic_fetch_add(&replay->next, 1,
+						__ATOMIC_RELAXED);
+		if (idx >= replay->num_execs)
+			break;
+		run_input(&corpus->inputs[idx % corpus->num_inputs]);
+	}
+	return NULL;
+}
+
+static double
+clock_monotonic(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Returns a number of executions per second. */
+static double
+replay_run(const struct corpus *corpus, int num_threads, int num_rounds)
+{
+	struct replay replay = {
+		.corpus = corpus,
+		.num_execs = corpus->num_inputs * num_rounds,
+		.next = 0,
+	};
+	pthread_t *threads = (pthread_t *)calloc(num_threads,
+						 sizeof(*threads));
+	if (threads == NULL) {
+		perror("calloc");
+		abort();
+	}
+
+	double start = clock_monotonic();
+	for (int i = 0; i < num_threads; i++) {
+		if (pthread_create(&threads[i], NULL, replay_worker,
+				   &replay) != 0) {
+			perror("pthread_create");
+			abort();
+		}
+	}
+	for (int i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+	double elapsed = clock_monotonic() - start;
+	free(threads);
+
+	double execs_per_sec = elapsed > 0 ? replay.num_execs / elapsed : 0;
+	return execs_per_sec;
+}
+
+static void
+usage(const char *progname)
+{
+	fprintf(stderr,
+		"Usage: %s [-j threads] [-n rounds] path...\n", progname);
+}
+
+int
+main(int argc, char **argv)
+{
+	int max_threads = 0;
+	int num_rounds = 1;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:n:")) != -1) {
+		switch (opt) {
+		case 'j':
+			max_threads = atoi(optarg);
+			break;
+		case 'n':
+			num_rounds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind == argc || num_rounds <= 0 || max_threads < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (LLVMFuzzerInitialize)
+		LLVMFuzzerInitialize(&argc, &argv);
+
+	struct corpus corpus = {0};
+	int rc = 0;
+	for (int i = optind; i < argc; i++) {
+		if (corpus_add_path(&corpus, argv[i]) != 0)
+			rc = 1;
+	}
+	if (corpus.num_inputs == 0) {
+		fprintf(stderr, "Corpus is empty.\n");
+		corpus_free(&corpus);
+		return 1;
+	}
+
+	int min_threads = max_threads;
+	if (max_threads == 0) {
+		min_threads = 1;
+		max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if (max_threads < 1)
+			max_threads = 1;
+	}
+
+	printf("Corpus size: %zu, rounds: %d\n", corpus.num_inputs,
+	       num_rounds);
+	double base = 0;
+	int n = min_threads;
+	for (;;) {
+		double execs_per_sec = replay_run(&corpus, n, num_rounds);
+		printf("threads: %3d, exec/s: %10.0f", n, execs_per_sec);
+		/* Speedup is relative to a single thread throughput. */
+		if (n == 1)
+			base = execs_per_sec;
+		if (base > 0) {
+			double speedup = execs_per_sec / base;
+			printf(", speedup: %6.2f, efficiency: %3.0f%%",
+			       speedup, speedup * 100 / n);
+		}
+		printf("\n");
+		if (n == max_threads)
+			break;
+		/* Always finish with all online CPUs. */
+		n = n * 2 > max_threads ? max_threads : n * 2;
+	}
+
+	corpus_free(&corpus);
+	return rc;
+}
@@ -0,0 +1,130 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright 2025, Sergey Bronnikov.
+ */
+
+/**
+ * Snapshot mode allows building a fully initialized Lua state
+ * once and executing every input in a child process forked from
+ * a harness. The child gets a copy-on-write copy of the state, so
+ * the setup cost is paid once, and a crashed runtime cannot
+ * poison the state in the parent. Coverage counters and a
+ * harness-defined payload (e.g. metrics) are passed back to the
+ * parent via a shared memory.
+ *
+ * Snapshot mode is enabled by the environment variable
+ * LUA_FUZZER_SNAPSHOT. Beware, value profile (`-use_value_profile`)
+ * and comparison tracing are not passed back to the parent.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "coverage.h"
+
+struct snapshot {
+	/* Shared memory with coverage counters and a payload. */
+	uint8_t *shm;
+	size_t shm_size;
+	size_t payload_size;
+};
+
+typedef void (*snapshot_func)(void *ctx);
+
+static inline int
+snapshot_is_enabled(void)
+{
+	return getenv("LUA_FUZZER_SNAPSHOT") != NULL;
+}
+
+/**
+ * Allocate a shared memory for coverage counters and a payload
+ * with a given size. Returns 0 on success and -1 otherwise.
+ */
+static inline int
+snapshot_init(struct snapshot *snapshot, size_t payload_size)
+{
+	snapshot->payload_size = payload_size;
+	/* Zero-length mappings are not allowed. */
+	snapshot->shm_size = cov_counters_size() + payload_size + 1;
+	void *shm = mmap(NULL, snapshot->shm_size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shm == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+	snapshot->shm = (uint8_t *)shm;
+	return 0;
+}
+
+/**
+ * Execute a function `func` in a child process. The payload is
+ * passed to the child by fork() and copied back when the child
+ * exits. When the child is terminated abnormally, the parent
+ * aborts, so the fuzzing engine saves the input.
+ */
+static inline void
+snapshot_run(struct snapshot *snapshot, snapshot_func func, void *ctx,
+	     void *payload)
+{
+	uint8_t *counters = cov_counters();
+	size_t counters_size = cov_counters_size();
+	uint8_t *shm_payload = snapshot->shm + counters_size;
+
+	/* Don't let the child flush buffered output twice. */
+	fflush(stdout);
+	fflush(stderr);
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		abort();
+	}
+	if (pid == 0) {
+		func(ctx);
+		if (counters_size != 0)
+			memcpy(snapshot->shm, counters, counters_size);
+		if (snapshot->payload_size != 0)
+			memcpy(shm_payload, payload, snapshot->payload_size);
+		fflush(stdout);
+		fflush(stderr);
+		/* Skip atexit handlers and destructors of the parent. */
+		_exit(0);
+	}
+
+	int status;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) {
+			perror("waitpid");
+			abort();
+		}
+	}
+	if (WIFSIGNALED(status)) {
+		fprintf(stderr, "Snapshot child %d is killed by signal %d.\n",
+			pid, WTERMSIG(status));
+		abort();
+	}
+	if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "Snapshot child %d exited with status %d.\n",
+			pid, WEXITSTATUS(status));
+		abort();
+	}
+
+	for (size_t i = 0; i < counters_size; i++) {
+		if (snapshot->shm[i] > counters[i])
+			counters[i] = snapshot->shm[i];
+	}
+	if (snapshot->payload_size != 0)
+		memcpy(payload, shm_payload, snapshot->payload_size);
+}
+
+#endif /* SNAPSHOT_H */
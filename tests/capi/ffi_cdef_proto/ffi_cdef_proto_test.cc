@@ -18,10 +18,15 @@ extern "C"
 
 #include "cdef.pb.h"
 #include "cdef_print.h"
+#include "grammar_weights.h"
+#include "proto_arena.h"
+#include "snapshot.h"
 
 #include <libprotobuf-mutator/port/protobuf.h>
 #include <libprotobuf-mutator/src/libfuzzer/libfuzzer_macro.h>
 
+#define UNUSED __attribute__((unused))
+
 /**
  * Get an error message from the stack, and report it to std::cerr.
  * Remove the message from the stack.
@@ -39,25 +44,9 @@ report_error(lua_State *L, const std::string &prefix)
 	std::cerr << prefix << " error: " << err_str << std::endl;
 }
 
-DEFINE_PROTO_FUZZER(const cdef::Declarations &message)
+static void
+run_chunk(lua_State *L, const std::string &chunk)
 {
-	lua_State *L = luaL_newstate();
-	if (!L)
-		return;
-
-	std::string cdef = ffi_cdef_proto::MainDefinitionsToString(message);
-	std::string chunk = "local ffi = require('ffi')\n";
-	chunk += "ffi.cdef[[\n";
-	chunk += cdef;
-	chunk += "]]\n";
-
-	if (::getenv("LPM_DUMP_NATIVE_INPUT") && chunk.size() != 0) {
-		std::cout << "-------------------------" << std::endl;
-		std::cout << chunk << std::endl;
-	}
-
-	luaL_openlibs(L);
-
 	if (luaL_loadbuffer(L, chunk.c_str(), chunk.size(), "fuzz") != LUA_OK) {
 		report_error(L, "luaL_loadbuffer()");
 		goto end;
@@ -74,5 +63,67 @@ DEFINE_PROTO_FUZZER(const cdef::Declarations &message)
 
 end:
 	lua_settop(L, 0);
+}
+
+struct chunk_ctx {
+	lua_State *L;
+	const std::string *chunk;
+};
+
+static void
+run_chunk_snapshot(void *ctx)
+{
+	struct chunk_ctx *chunk_ctx = (struct chunk_ctx *)ctx;
+	run_chunk(chunk_ctx->L, *chunk_ctx->chunk);
+}
+
+/* Weights grammar productions by coverage, see grammar_weights.h. */
+UNUSED static bool grammar_weights_enabled =
+	grammar_weights_register(cdef::Declarations::descriptor());
+
+DEFINE_ARENA_PROTO_FUZZER(cdef::Declarations, message)
+{
+	struct grammar_weights_tracker tracker(message);
+	std::string cdef = ffi_cdef_proto::MainDefinitionsToString(message);
+	std::string chunk = "local ffi = require('ffi')\n";
+	chunk += "ffi.cdef[[\n";
+	chunk += cdef;
+	chunk += "]]\n";
+
+	if (::getenv("LPM_DUMP_NATIVE_INPUT") && chunk.size() != 0) {
+		std::cout << "-------------------------" << std::endl;
+		std::cout << chunk << std::endl;
+	}
+
+	if (snapshot_is_enabled()) {
+		/*
+		 * Lua state is initialized once and shared by
+		 * children, `require('ffi')` in the chunk returns
+		 * an already loaded module.
+		 */
+		static lua_State *snapshot_L = NULL;
+		static struct snapshot snapshot;
+		if (!snapshot_L) {
+			if (snapshot_init(&snapshot, 0) != 0)
+				abort();
+			snapshot_L = luaL_newstate();
+			if (!snapshot_L)
+				abort();
+			luaL_openlibs(snapshot_L);
+			if (luaL_dostring(snapshot_L, "require('ffi')") != LUA_OK)
+				abort();
+		}
+		struct chunk_ctx ctx = { snapshot_L, &chunk };
+		snapshot_run(&snapshot, run_chunk_snapshot, &ctx, NULL);
+		return;
+	}
+
+	lua_State *L = luaL_newstate();
+	if (!L)
+		return;
+
+	luaL_openlibs(L);
+	run_chunk(L, chunk);
+
 	lua_close(L);
 }
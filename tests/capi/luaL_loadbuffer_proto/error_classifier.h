@@ -0,0 +1,137 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright 2025, Sergey Bronnikov.
+ */
+
+/**
+ * Error classifier matches an error message against a set of
+ * patterns in a single pass over the message. Patterns are
+ * literal substrings, they are compiled to a deterministic
+ * Aho-Corasick automaton once, so a classification is a table
+ * lookup per byte without allocations and I/O.
+ *
+ * Patterns are passed as a text with a pattern per line, empty
+ * lines and lines starting with '#' are ignored, see
+ * extra/error_patterns.txt.
+ */
+
+#ifndef ERROR_CLASSIFIER_H
+#define ERROR_CLASSIFIER_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+/* A class is a bit in a 64-bit mask. */
+#define MAX_ERROR_CLASSES 64
+
+#define ALPHABET_SIZE 256
+
+struct error_classifier {
+	std::vector<std::string> patterns;
+	/* Transitions, ALPHABET_SIZE per state, state 0 is a root. */
+	std::vector<uint32_t> next;
+	/* A mask of patterns, that end in a state. */
+	std::vector<uint64_t> out;
+};
+
+static inline void
+error_classifier_add_pattern(struct error_classifier *c,
+			     const std::string &pattern)
+{
+	size_t idx = c->patterns.size();
+	assert(idx < MAX_ERROR_CLASSES);
+	c->patterns.push_back(pattern);
+
+	uint32_t state = 0;
+	for (unsigned char ch : pattern) {
+		uint32_t *next = &c->next[state * ALPHABET_SIZE + ch];
+		if (*next == 0) {
+			*next = c->out.size();
+			c->out.push_back(0);
+			c->next.resize(c->next.size() + ALPHABET_SIZE, 0);
+			/* Vector is reallocated. */
+			next = &c->next[state * ALPHABET_SIZE + ch];
+		}
+		state = *next;
+	}
+	c->out[state] |= UINT64_C(1) << idx;
+}
+
+/*
+ * Turns a trie into an automaton: a missed transition is
+ * replaced by a transition of the longest proper suffix, that is
+ * in the trie, and output masks are merged along suffix links.
+ * States are processed in BFS order, so a suffix state is
+ * complete before it is used.
+ */
+static inline void
+error_classifier_build(struct error_classifier *c)
+{
+	size_t num_states = c->out.size();
+	std::vector<uint32_t> fail(num_states, 0);
+	std::vector<uint32_t> queue;
+	queue.reserve(num_states);
+	for (size_t ch = 0; ch < ALPHABET_SIZE; ch++) {
+		uint32_t child = c->next[ch];
+		if (child != 0)
+			queue.push_back(child);
+	}
+	for (size_t i = 0; i < queue.size(); i++) {
+		uint32_t state = queue[i];
+		for (size_t ch = 0; ch < ALPHABET_SIZE; ch++) {
+			uint32_t *next = &c->next[state * ALPHABET_SIZE + ch];
+			uint32_t suffix_next =
+				c->next[fail[state] * ALPHABET_SIZE + ch];
+			if (*next == 0) {
+				*next = suffix_next;
+				continue;
+			}
+			fail[*next] = suffix_next;
+			c->out[*next] |= c->out[suffix_next];
+			queue.push_back(*next);
+		}
+	}
+}
+
+static inline void
+error_classifier_create(struct error_classifier *c, const char *patterns)
+{
+	/* Root state. */
+	c->out.assign(1, 0);
+	c->next.assign(ALPHABET_SIZE, 0);
+	c->patterns.clear();
+
+	const char *line = patterns;
+	while (*line != '\0') {
+		const char *end = strchr(line, '\n');
+		size_t len = end ? (size_t)(end - line) : strlen(line);
+		if (len != 0 && line[0] != '#')
+			error_classifier_add_pattern(c, std::string(line, len));
+		line += end ? len + 1 : len;
+	}
+	error_classifier_build(c);
+}
+
+/**
+ * Returns a mask of patterns found in a string, a bit `i` is set
+ * when a pattern `c->patterns[i]` is found.
+ */
+static inline uint64_t
+error_classifier_match(const struct error_classifier *c, const char *str,
+		       size_t len)
+{
+	uint32_t state = 0;
+	uint64_t mask = 0;
+	for (size_t i = 0; i < len; i++) {
+		state = c->next[state * ALPHABET_SIZE + (unsigned char)str[i]];
+		mask |= c->out[state];
+	}
+	return mask;
+}
+
+#endif /* ERROR_CLASSIFIER_H */
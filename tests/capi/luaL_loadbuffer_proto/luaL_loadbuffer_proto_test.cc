@@ -14,11 +14,17 @@ extern "C"
 #include "luajit.h"
 #endif /* LUAJIT */
 #include <signal.h>
+#include <stdlib.h>
 #include <unistd.h>
 }
 
+#include "error_classifier.h"
+#include "grammar_weights.h"
 #include "lua_grammar.pb.h"
+#include "post_processor.h"
+#include "proto_arena.h"
 #include "serializer.h"
+#include "snapshot.h"
 
 #include <libprotobuf-mutator/port/protobuf.h>
 #include <libprotobuf-mutator/src/libfuzzer/libfuzzer_macro.h>
@@ -40,8 +46,19 @@ struct metrics {
 	size_t jit_trace_stop;
 	size_t bc_num;
 	size_t texit_num;
+	/* Errors per class, see extra/error_patterns.txt. */
+	size_t errors[MAX_ERROR_CLASSES];
+	size_t errors_unmatched;
+	/* Heap allocations made by decoding of messages. */
+	size_t proto_allocs;
+};
 
-	/* Per test sample. */
+/*
+ * Per test sample. Lua states may run in several threads
+ * in parallel (see replay.c), JIT callbacks are called in the
+ * thread that runs the state, so flags are thread-local.
+ */
+struct sample_metrics {
 	bool is_trace_abort;
 	bool is_trace_start;
 	bool is_trace_stop;
@@ -51,6 +68,62 @@ struct metrics {
 };
 
 static struct metrics metrics;
+static thread_local struct sample_metrics sample_metrics;
+
+/*
+ * With LUA_FUZZER_PREAMBLE_LITE generated programs do not set
+ * metatables for values of non-table types, see preamble_lite.lua.
+ * With LUA_FUZZER_LOCAL_COUNTERS loop and recursion counters are
+ * locals of an enclosing function instead of globals.
+ * LUA_FUZZER_JIT_STRESS enables a JIT-stress profile, a value is
+ * a number of iterations of hot loops, kJitStressTripCount is used
+ * when the value is not a positive number.
+ */
+static const luajit_fuzzer::SerializerOptions &
+get_serializer_options(void)
+{
+	static const luajit_fuzzer::SerializerOptions options = [] {
+		luajit_fuzzer::SerializerOptions opts;
+		opts.preamble_lite =
+			::getenv("LUA_FUZZER_PREAMBLE_LITE") != NULL;
+		opts.local_counters =
+			::getenv("LUA_FUZZER_LOCAL_COUNTERS") != NULL;
+		const char *jit_stress = ::getenv("LUA_FUZZER_JIT_STRESS");
+		if (jit_stress != NULL) {
+			long trip_count = strtol(jit_stress, NULL, 10);
+			opts.jit_trip_count = trip_count > 0 ? trip_count :
+				luajit_fuzzer::kJitStressTripCount;
+		}
+		/* The preamble is executed once in a snapshot. */
+		opts.preamble_in_state = snapshot_is_enabled();
+		return opts;
+	}();
+	return options;
+}
+
+extern char error_patterns[];
+
+/*
+ * The classifier is built once on the first use and is read-only
+ * after that, so it is shared by all threads.
+ */
+static const struct error_classifier *
+get_error_classifier(void)
+{
+	static const struct error_classifier *classifier = [] {
+		struct error_classifier *c = new struct error_classifier;
+		error_classifier_create(c, error_patterns);
+		return c;
+	}();
+	return classifier;
+}
+
+/* Counters are shared by all threads, see replay.c. */
+static inline void
+metrics_increment(size_t *counter)
+{
+	__atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+}
 
 UNUSED static void
 jit_attach(lua_State *L, void *func, const char *event)
@@ -77,9 +150,9 @@ jit_attach(lua_State *L, void *func, const char *event)
  */
 UNUSED static int
 record_cb(lua_State *L) {
-	if (!metrics.is_trace_record) {
-		metrics.jit_trace_record++;
-		metrics.is_trace_record = true;
+	if (!sample_metrics.is_trace_record) {
+		metrics_increment(&metrics.jit_trace_record);
+		sample_metrics.is_trace_record = true;
 	}
 	return 0;
 }
@@ -91,9 +164,9 @@ record_cb(lua_State *L) {
  */
 UNUSED static int
 bc_cb(lua_State *L) {
-	if (!metrics.is_bc) {
-		metrics.bc_num++;
-		metrics.is_bc = true;
+	if (!sample_metrics.is_bc) {
+		metrics_increment(&metrics.bc_num);
+		sample_metrics.is_bc = true;
 	}
 	return 0;
 }
@@ -105,9 +178,9 @@ bc_cb(lua_State *L) {
  */
 UNUSED static int
 texit_cb(lua_State *L) {
-	if (!metrics.is_texit) {
-		metrics.texit_num++;
-		metrics.is_texit = true;
+	if (!sample_metrics.is_texit) {
+		metrics_increment(&metrics.texit_num);
+		sample_metrics.is_texit = true;
 	}
 	return 0;
 }
@@ -120,17 +193,17 @@ texit_cb(lua_State *L) {
 UNUSED static int
 trace_cb(lua_State *L) {
 	const char *what = lua_tostring(L, 1);
-	if (strcmp(what, "abort") == 0 && !metrics.is_trace_abort) {
-		metrics.jit_trace_abort++;
-		metrics.is_trace_abort = true;
+	if (strcmp(what, "abort") == 0 && !sample_metrics.is_trace_abort) {
+		metrics_increment(&metrics.jit_trace_abort);
+		sample_metrics.is_trace_abort = true;
 	}
-	if (strcmp(what, "start") == 0 && !metrics.is_trace_start) {
-		metrics.jit_trace_start++;
-		metrics.is_trace_start = true;
+	if (strcmp(what, "start") == 0 && !sample_metrics.is_trace_start) {
+		metrics_increment(&metrics.jit_trace_start);
+		sample_metrics.is_trace_start = true;
 	}
-	if (strcmp(what, "stop") == 0 && !metrics.is_trace_stop) {
-		metrics.jit_trace_stop++;
-		metrics.is_trace_stop = true;
+	if (strcmp(what, "stop") == 0 && !sample_metrics.is_trace_stop) {
+		metrics_increment(&metrics.jit_trace_stop);
+		sample_metrics.is_trace_stop = true;
 	}
 	return 0;
 }
@@ -141,10 +214,36 @@ print_metrics(struct metrics *metrics)
 	if (metrics->total_num == 0)
 		return;
 
+	std::cout << "Preamble: "
+		  << (get_serializer_options().preamble_lite ?
+		      "preamble_lite.lua" : "preamble.lua") << std::endl;
+	std::cout << "Counters: "
+		  << (get_serializer_options().local_counters ?
+		      "local" : "global") << std::endl;
+	if (get_serializer_options().jit_trip_count != 0)
+		std::cout << "JIT stress, trip count: "
+			  << get_serializer_options().jit_trip_count
+			  << std::endl;
+	std::cout << "Protobuf arena: "
+		  << (proto_arena_is_enabled() ? "on" : "off") << std::endl;
+	std::cout << "Grammar weights: "
+		  << (grammar_weights() != NULL ? "on" : "off") << std::endl;
 	std::cout << "Total number of samples: "
 		  << metrics->total_num << std::endl;
+	std::cout << "Protobuf allocations per sample: "
+		  << metrics->proto_allocs / metrics->total_num << std::endl;
 	PRINT_METRIC("Total number of samples with errors: ",
 		     metrics->total_num_with_errors, metrics->total_num);
+	const struct error_classifier *classifier = get_error_classifier();
+	for (size_t i = 0; i < classifier->patterns.size(); i++) {
+		if (metrics->errors[i] == 0)
+			continue;
+		PRINT_METRIC("Total number of errors '" +
+			     classifier->patterns[i] + "': ",
+			     metrics->errors[i], metrics->total_num);
+	}
+	PRINT_METRIC("Total number of unclassified errors: ",
+		     metrics->errors_unmatched, metrics->total_num);
 #ifdef LUAJIT
 	PRINT_METRIC("Total number of samples with record traces: ",
 		     metrics->jit_trace_record, metrics->total_num);
@@ -164,15 +263,17 @@ print_metrics(struct metrics *metrics)
 static inline void
 metrics_increment_num_samples(struct metrics *metrics)
 {
-	metrics->total_num++;
+	metrics_increment(&metrics->total_num);
 }
 
 static inline void
 metrics_increment_num_error_samples(struct metrics *metrics)
 {
-	metrics->total_num_with_errors++;
+	metrics_increment(&metrics->total_num_with_errors);
 }
 
+UNUSED static bool profiler_busy;
+
 UNUSED static void
 profiler_cb(lua_State *L, void *data, int samples, int vmstate)
 {
@@ -181,19 +282,39 @@ profiler_cb(lua_State *L, void *data, int samples, int vmstate)
 	/* Do nothing. */
 }
 
+static void
+metrics_increment_error_classes(struct metrics *metrics, const char *errmsg,
+				size_t len)
+{
+	uint64_t mask = error_classifier_match(get_error_classifier(),
+					       errmsg, len);
+	if (mask == 0) {
+		metrics_increment(&metrics->errors_unmatched);
+		return;
+	}
+	for (size_t i = 0; mask != 0; i++, mask >>= 1) {
+		if (mask & 1)
+			metrics_increment(&metrics->errors[i]);
+	}
+}
+
 /**
- * Get an error message from the stack, and report it to std::cerr.
+ * Get an error message from the stack, count its error classes
+ * and report it to std::cerr with LUA_FUZZER_VERBOSE.
  * Remove the message from the stack.
  */
 static inline void
 report_error(lua_State *L, const std::string &prefix)
 {
 	metrics_increment_num_error_samples(&metrics);
+	size_t len = 0;
+	const char *errmsg = lua_tolstring(L, 1, &len);
+	if (errmsg)
+		metrics_increment_error_classes(&metrics, errmsg, len);
 	const char *verbose = ::getenv("LUA_FUZZER_VERBOSE");
 	if (!verbose)
 		return;
 
-	const char *errmsg = lua_tostring(L, 1);
 	std::string err_str = errmsg ? errmsg : "(null)";
 	/* Pop error message from stack. */
 	lua_pop(L, 1);
@@ -211,6 +332,7 @@ static void
 setup(void)
 {
 	metrics = {};
+	get_error_classifier();
 	struct sigaction act = {};
 	act.sa_flags = SA_SIGINFO;
 	act.sa_sigaction = &sig_handler;
@@ -225,20 +347,20 @@ teardown(void)
 }
 
 UNUSED static inline void
-reset_lj_metrics(struct metrics *metrics)
+reset_lj_metrics(struct sample_metrics *sample)
 {
-	metrics->is_trace_start = false;
-	metrics->is_trace_stop = false;
-	metrics->is_trace_abort = false;
-	metrics->is_trace_record = false;
-	metrics->is_bc = false;
-	metrics->is_texit = false;
+	sample->is_trace_start = false;
+	sample->is_trace_stop = false;
+	sample->is_trace_abort = false;
+	sample->is_trace_record = false;
+	sample->is_bc = false;
+	sample->is_texit = false;
 }
 
 UNUSED static void
 enable_lj_metrics(lua_State *L, struct metrics *metrics)
 {
-	reset_lj_metrics(metrics);
+	reset_lj_metrics(&sample_metrics);
 	jit_attach(L, (void *)bc_cb, "bc");
 	jit_attach(L, (void *)record_cb, "record");
 	jit_attach(L, (void *)texit_cb, "texit");
@@ -254,29 +376,25 @@ disable_lj_metrics(lua_State *L, struct metrics *metrics)
 	jit_attach(L, (void *)trace_cb, NULL);
 }
 
-DEFINE_PROTO_FUZZER(const lua_grammar::Block &message)
+static void
+init_lua_state(lua_State *L)
 {
-	lua_State *L = luaL_newstate();
-	if (!L)
-		return;
-
-	std::string code = luajit_fuzzer::MainBlockToString(message);
-
-	if (::getenv("LPM_DUMP_NATIVE_INPUT") && code.size() != 0) {
-		std::cout << "-------------------------" << std::endl;
-		std::cout << code << std::endl;
-	}
-
 	luaL_openlibs(L);
 
 #ifdef LUAJIT
-	enable_lj_metrics(L, &metrics);
-
 	/* See https://luajit.org/running.html. */
 	luaL_dostring(L, "jit.opt.start('hotloop=1')");
 	luaL_dostring(L, "jit.opt.start('hotexit=1')");
 	luaL_dostring(L, "jit.opt.start('recunroll=1')");
 	luaL_dostring(L, "jit.opt.start('callunroll=1')");
+#endif /* LUAJIT */
+}
+
+static void
+run_chunk(lua_State *L, const std::string &code)
+{
+#ifdef LUAJIT
+	enable_lj_metrics(L, &metrics);
 
 	/*
 	 * The `mode` argument is a string holding options:
@@ -288,8 +406,17 @@ DEFINE_PROTO_FUZZER(const lua_grammar::Block &message)
 	size_t depth = 5;
 	int len = 5;
 
+	/*
+	 * The profiler is a process-wide singleton in LuaJIT, so
+	 * it is started only by a single state at the same time.
+	 */
+	bool is_profiler_owner = !__atomic_test_and_set(&profiler_busy,
+							__ATOMIC_ACQUIRE);
 	/* Start profiler. */
-	luaJIT_profile_start(L, mode, (luaJIT_profile_callback)profiler_cb, NULL);
+	if (is_profiler_owner)
+		luaJIT_profile_start(L, mode,
+				     (luaJIT_profile_callback)profiler_cb,
+				     NULL);
 
 	/*
 	 * Function allows taking stack dumps in an efficient manner, returns a
@@ -327,9 +454,81 @@ end:
 #ifdef LUAJIT
 	disable_lj_metrics(L, &metrics);
 	/* Stop profiler. */
-	luaJIT_profile_stop(L);
+	if (is_profiler_owner) {
+		luaJIT_profile_stop(L);
+		__atomic_clear(&profiler_busy, __ATOMIC_RELEASE);
+	}
 #endif /* LUAJIT */
 
 	lua_settop(L, 0);
+}
+
+struct chunk_ctx {
+	lua_State *L;
+	const std::string *code;
+};
+
+static void
+run_chunk_snapshot(void *ctx)
+{
+	struct chunk_ctx *chunk_ctx = (struct chunk_ctx *)ctx;
+	run_chunk(chunk_ctx->L, *chunk_ctx->code);
+}
+
+/* Normalizes messages after mutations, see post_processor.h. */
+static protobuf_mutator::libfuzzer::
+PostProcessorRegistration<lua_grammar::Block> reg = {
+	[](lua_grammar::Block *message, unsigned int seed) {
+		(void)seed;
+		if (proto_arena_is_root(message))
+			post_process_block(message);
+	}
+};
+
+/* Weights grammar productions by coverage, see grammar_weights.h. */
+UNUSED static bool grammar_weights_enabled =
+	grammar_weights_register(lua_grammar::Block::descriptor());
+
+DEFINE_ARENA_PROTO_FUZZER(lua_grammar::Block, message)
+{
+	struct grammar_weights_tracker tracker(message);
+	__atomic_add_fetch(&metrics.proto_allocs, proto_arena_last_allocs(),
+			   __ATOMIC_RELAXED);
+	std::string code = luajit_fuzzer::MainBlockToString(message,
+		get_serializer_options());
+
+	if (::getenv("LPM_DUMP_NATIVE_INPUT") && code.size() != 0) {
+		std::cout << "-------------------------" << std::endl;
+		std::cout << code << std::endl;
+	}
+
+	if (snapshot_is_enabled()) {
+		/* Lua state is initialized once and shared by children. */
+		static lua_State *snapshot_L = NULL;
+		static struct snapshot snapshot;
+		if (!snapshot_L) {
+			if (snapshot_init(&snapshot, sizeof(metrics)) != 0)
+				abort();
+			snapshot_L = luaL_newstate();
+			if (!snapshot_L)
+				abort();
+			init_lua_state(snapshot_L);
+			std::string preamble = luajit_fuzzer::PreambleToString(
+				get_serializer_options());
+			if (luaL_dostring(snapshot_L, preamble.c_str()) != 0)
+				abort();
+		}
+		struct chunk_ctx ctx = { snapshot_L, &code };
+		snapshot_run(&snapshot, run_chunk_snapshot, &ctx, &metrics);
+		return;
+	}
+
+	lua_State *L = luaL_newstate();
+	if (!L)
+		return;
+
+	init_lua_state(L);
+	run_chunk(L, code);
+
 	lua_close(L);
 }
@@ -0,0 +1,165 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright 2025, Sergey Bronnikov.
+ */
+
+/**
+ * Post-processor normalizes a Lua grammar message after every
+ * mutation and crossover made by libprotobuf-mutator, so messages
+ * stored in a corpus are already cheap to execute:
+ *
+ * - blocks nested deeper than MAX_BLOCK_DEPTH are emptied;
+ * - expressions nested deeper than MAX_EXPRESSION_DEPTH and
+ *   expressions after the first MAX_EXPRESSIONS ones are replaced
+ *   by `nil`;
+ * - identifiers, that are not valid Lua names, are replaced by
+ *   default names `Name<num>` with `num` less than
+ *   kMaxIdentifiers, and duplicate names are removed from name
+ *   lists, see serializer.cc.
+ *
+ * The post-processor is registered for a Block message.
+ * libprotobuf-mutator calls post-processors for nested messages
+ * before their parents, so nested blocks are skipped and a whole
+ * message is normalized once with a root block, see
+ * proto_arena_is_root().
+ */
+
+#ifndef POST_PROCESSOR_H
+#define POST_PROCESSOR_H
+
+#include <ctype.h>
+
+#include <string>
+#include <vector>
+
+#include "lua_grammar.pb.h"
+#include "serializer.h"
+
+#define MAX_BLOCK_DEPTH 8
+#define MAX_EXPRESSION_DEPTH 16
+#define MAX_EXPRESSIONS 512
+
+struct post_processor_ctx {
+	size_t block_depth;
+	size_t expression_depth;
+	size_t num_expressions;
+};
+
+static inline bool
+is_lua_name(const std::string &name)
+{
+	if (name.empty() || name.size() > luajit_fuzzer::kMaxStrLength)
+		return false;
+	if (isdigit((unsigned char)name[0]))
+		return false;
+	for (unsigned char c : name) {
+		if (!isalnum(c) && c != '_')
+			return false;
+	}
+	return true;
+}
+
+/* Returns an identifier produced by the serializer for a name. */
+static inline std::string
+normalize_name(lua_grammar::Name *name)
+{
+	using luajit_fuzzer::kDefaultIdent;
+	using luajit_fuzzer::kMaxIdentifiers;
+
+	if (!is_lua_name(name->name()) || name->name() == kDefaultIdent) {
+		name->set_name("");
+		name->set_num(name->num() % kMaxIdentifiers);
+		return kDefaultIdent + std::to_string(name->num());
+	}
+	return name->name();
+}
+
+static inline void
+normalize_name_list(lua_grammar::NameList *namelist)
+{
+	std::vector<std::string> seen;
+	seen.push_back(normalize_name(namelist->mutable_firstname()));
+	auto *names = namelist->mutable_names();
+	for (int i = 0; i < names->size();) {
+		std::string name = normalize_name(names->Mutable(i));
+		bool is_dup = false;
+		for (const std::string &s : seen)
+			is_dup = is_dup || s == name;
+		if (is_dup) {
+			names->DeleteSubrange(i, 1);
+			continue;
+		}
+		seen.push_back(name);
+		i++;
+	}
+}
+
+static inline void
+normalize_message(google::protobuf::Message *message,
+		  struct post_processor_ctx *ctx)
+{
+	using google::protobuf::FieldDescriptor;
+
+	const google::protobuf::Descriptor *descriptor =
+		message->GetDescriptor();
+	size_t block_depth = ctx->block_depth;
+	size_t expression_depth = ctx->expression_depth;
+	if (descriptor == lua_grammar::Block::descriptor()) {
+		if (ctx->block_depth >= MAX_BLOCK_DEPTH) {
+			auto *block = static_cast<lua_grammar::Block *>(message);
+			block->mutable_chunk()->Clear();
+			return;
+		}
+		ctx->block_depth++;
+	} else if (descriptor == lua_grammar::Expression::descriptor()) {
+		if (ctx->expression_depth >= MAX_EXPRESSION_DEPTH ||
+		    ctx->num_expressions >= MAX_EXPRESSIONS) {
+			auto *expr = static_cast<lua_grammar::Expression *>(message);
+			expr->set_nil(0);
+			return;
+		}
+		ctx->expression_depth++;
+		ctx->num_expressions++;
+	} else if (descriptor == lua_grammar::NameList::descriptor()) {
+		normalize_name_list(
+			static_cast<lua_grammar::NameList *>(message));
+		return;
+	} else if (descriptor == lua_grammar::Name::descriptor()) {
+		normalize_name(static_cast<lua_grammar::Name *>(message));
+		return;
+	}
+
+	const google::protobuf::Reflection *reflection =
+		message->GetReflection();
+	std::vector<const FieldDescriptor *> fields;
+	reflection->ListFields(*message, &fields);
+	for (const FieldDescriptor *field : fields) {
+		if (field->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE)
+			continue;
+		if (!field->is_repeated()) {
+			normalize_message(reflection->MutableMessage(message,
+								     field),
+					  ctx);
+			continue;
+		}
+		int size = reflection->FieldSize(*message, field);
+		for (int i = 0; i < size; i++) {
+			normalize_message(
+				reflection->MutableRepeatedMessage(message,
+								   field, i),
+				ctx);
+		}
+	}
+	ctx->block_depth = block_depth;
+	ctx->expression_depth = expression_depth;
+}
+
+static inline void
+post_process_block(lua_grammar::Block *block)
+{
+	struct post_processor_ctx ctx = {};
+	normalize_message(block, &ctx);
+}
+
+#endif /* POST_PROCESSOR_H */
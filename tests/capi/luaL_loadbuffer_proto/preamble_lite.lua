@@ -0,0 +1,87 @@
+-- The preamble is used with LUA_FUZZER_PREAMBLE_LITE. Unlike
+-- preamble.lua, it does not set metatables for strings, numbers,
+-- nil, booleans and functions, so operations on values of these
+-- types use fast paths in the VM. The serializer wraps operands,
+-- when their types are not known, by functions defined below.
+
+local DEFAULT_NUMBER = 1
+
+local always_number = function(val)
+    return tonumber(val) or DEFAULT_NUMBER
+end
+
+local always_string = function(val)
+    local t = type(val)
+    if t == 'string' or t == 'number' then
+        return val
+    end
+    return tostring(val)
+end
+
+local not_nan_and_nil = function(val)
+    return (val ~= val or val == nil) and DEFAULT_NUMBER or val
+end
+
+local __call = function(self)
+    return self
+end
+local __newindex = function(self, key, value)
+    if key ~= key or key == nil then
+        key = tostring(key)
+    end
+    rawset(self, key, value)
+end
+
+local table_mt = {
+    __call = __call,
+    __newindex = __newindex,
+}
+
+-- A value, that is not a table, is replaced by an empty table.
+local always_table = function(val)
+    if type(val) == 'table' then
+        return val
+    end
+    return setmetatable({}, table_mt)
+end
+
+-- A value, that is not callable, is replaced by a function,
+-- that returns the value, like `__call` in preamble.lua.
+local always_function = function(val)
+    if type(val) == 'function' then
+        return val
+    end
+    local mt = getmetatable(val)
+    if type(mt) == 'table' and mt.__call ~= nil then
+        return val
+    end
+    return function()
+        return val
+    end
+end
+
+local method_call = function(obj, name, ...)
+    local method
+    if type(obj) == 'string' then
+        method = string[name]
+    else
+        method = always_table(obj)[name]
+    end
+    return always_function(method)(obj, ...)
+end
+
+local only_numbers_cmp = function(v1, v2, cmp_op_str)
+    local op_func = {
+        ['<'] = function(a1, a2) return a1 < a2 end,
+        ['<='] = function(a1, a2) return a1 <= a2 end,
+        ['>'] = function(a1, a2) return a1 > a2 end,
+        ['>='] = function(a1, a2) return a1 >= a2 end,
+    }
+    if type(v1) == 'number' and
+       type(v2) == 'number' then
+        return op_func[cmp_op_str](v1, v2)
+    end
+    return false
+end
+
+---------------------- END OF PREAMBLE ----------------------------
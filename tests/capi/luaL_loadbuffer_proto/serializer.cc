@@ -5,8 +5,12 @@
  */
 #include "serializer.h"
 
+#include <functional>
+#include <map>
+#include <set>
 #include <stack>
 #include <string>
+#include <vector>
 
 /**
 * If control flow reaches the point of the unreachable(), the program is
@@ -22,6 +26,7 @@
 using namespace lua_grammar;
 
 extern char preamble_lua[];
+extern char preamble_lite_lua[];
 
 #define PROTO_TOSTRING(TYPE, VAR_NAME) \
 	std::string TYPE##ToString(const TYPE & (VAR_NAME))
@@ -65,7 +70,13 @@ const std::set<std::string> KReservedLuaKeywords {
 const std::string kCounterNamePrefix = "counter_";
 const std::string kNumberWrapperName = "always_number";
 const std::string kBinOpWrapperName = "only_numbers_cmp";
+const std::string kHotArrayName = "hot_array";
 const std::string kNotNaNAndNilWrapperName = "not_nan_and_nil";
+/* Guards defined in preamble_lite.lua. */
+const std::string kStringWrapperName = "always_string";
+const std::string kTableWrapperName = "always_table";
+const std::string kFunctionWrapperName = "always_function";
+const std::string kMethodCallName = "method_call";
 
 PROTO_TOSTRING(Block, block);
 PROTO_TOSTRING(Chunk, chunk);
@@ -155,18 +166,6 @@ PROTO_TOSTRING(UnaryOperator, op);
 /** Identifier (Name). */
 PROTO_TOSTRING(Name, name);
 
-std::string
-NumberWrappedExpressionToString(const Expression &expr)
-{
-	std::string retval;
-	retval += kNumberWrapperName;
-	retval += "(";
-	retval += ExpressionToString(expr);
-	retval += ")";
-
-	return retval;
-}
-
 std::string
 AllowedIndexExpressionToString(const Expression &expr)
 {
@@ -209,14 +208,25 @@ private:
 	std::size_t id_ = 0;
 };
 
-/** A singleton for counter id provider. */
+/**
+ * A singleton for counter id provider. One instance per thread,
+ * so chunks can be serialized concurrently.
+ */
 CounterIdProvider&
 GetCounterIdProvider()
 {
-	static CounterIdProvider provider;
+	static thread_local CounterIdProvider provider;
 	return provider;
 }
 
+/** Options of the current serialization, see MainBlockToString(). */
+SerializerOptions&
+GetOptions()
+{
+	static thread_local SerializerOptions options;
+	return options;
+}
+
 std::string
 GetCounterName(std::size_t id)
 {
@@ -235,16 +245,17 @@ GetCounterIncrement(const std::string &counter_name)
 }
 
 /**
- * Returns `if <counter_name> > kMaxCounterValue then
+ * Returns `if <counter_name> > <max_value> then
  * <then_block> end`.
  */
 std::string
-GetCondition(const std::string &counter_name, const std::string &then_block)
+GetCondition(const std::string &counter_name, const std::string &then_block,
+	     std::size_t max_value = kMaxCounterValue)
 {
 	std::string retval = "if ";
 	retval += counter_name;
 	retval += " > ";
-	retval += std::to_string(kMaxCounterValue);
+	retval += std::to_string(max_value);
 	retval += " then ";
 	retval += then_block;
 	retval += " end\n";
@@ -264,6 +275,17 @@ public:
 		kReturnableWithVararg,
 	};
 
+	/* Types of values, kUnknown is compatible with any type. */
+	enum class ValueType {
+		kUnknown,
+		kNil,
+		kBoolean,
+		kNumber,
+		kString,
+		kTable,
+		kFunction,
+	};
+
 	void step_in(BlockType type)
 	{
 		block_stack_.push(type);
@@ -286,11 +308,46 @@ public:
 	{
 		std::size_t id = GetCounterIdProvider().next();
 		std::string counter_name = GetCounterName(id);
-
-		return GetCondition(counter_name, get_exit_statement_()) +
+		/*
+		 * A local counter is reset on every call of a function,
+		 * so counters are locals in functions with a limited
+		 * nesting depth only, see kMaxLocalCountersDepth.
+		 */
+		if (GetOptions().local_counters && !local_counters_.empty() &&
+		    local_counters_.size() <= kMaxLocalCountersDepth &&
+		    local_counters_.back().size() < kMaxLocalCounters)
+			local_counters_.back().push_back(id);
+		else
+			global_counters_.push_back(id);
+
+		/* Recursion is limited regardless of the JIT-stress profile. */
+		std::size_t max_value = kMaxCounterValue;
+		if (GetOptions().jit_trip_count != 0 && break_is_possible())
+			max_value = GetOptions().jit_trip_count;
+
+		return GetCondition(counter_name, get_exit_statement_(),
+				    max_value) +
 		       GetCounterIncrement(counter_name);
 	}
 
+	/** Hot loops of the JIT-stress profile, see ForCycleName. */
+	bool hot_loop_is_possible()
+	{
+		return GetOptions().jit_trip_count != 0 &&
+		       hot_loop_depth_ < kMaxHotLoopDepth;
+	}
+
+	void hot_loop_in()
+	{
+		++hot_loop_depth_;
+	}
+
+	void hot_loop_out()
+	{
+		assert(hot_loop_depth_ > 0);
+		--hot_loop_depth_;
+	}
+
 	bool break_is_possible()
 	{
 		return !block_stack_.empty() &&
@@ -310,8 +367,194 @@ public:
 				BlockType::kReturnableWithVararg));
 	}
 
+	/**
+	 * Scope and type environment. Every block has a scope with
+	 * local variables and their types, globals are tracked
+	 * separately. Types are a static approximation used to pick
+	 * variables of a plausible type, they are not required to be
+	 * precise.
+	 */
+	void scope_in()
+	{
+		scopes_.emplace_back();
+	}
+
+	void scope_out()
+	{
+		assert(!scopes_.empty());
+		scopes_.pop_back();
+	}
+
+	/**
+	 * Cleans types of globals and global counters. Should be used
+	 * to make fuzzer starts independent.
+	 */
+	void clean_globals()
+	{
+		assert(scopes_.empty());
+		assert(local_counters_.empty());
+		assert(hot_loop_depth_ == 0);
+		globals_.clear();
+		global_counters_.clear();
+		reassigned_.clear();
+	}
+
+	/**
+	 * Sets names of variables, that are assigned somewhere in
+	 * a program, see fixed_type().
+	 */
+	void set_reassigned(std::set<std::string> names)
+	{
+		reassigned_ = std::move(names);
+	}
+
+	/**
+	 * Local counters of a function, see `local_counters` in
+	 * SerializerOptions. Counters are registered between
+	 * counters_in() and counters_out(), the latter returns ids
+	 * of counters to declare at the beginning of the function.
+	 */
+	void counters_in()
+	{
+		local_counters_.emplace_back();
+	}
+
+	std::vector<std::size_t> counters_out()
+	{
+		assert(!local_counters_.empty());
+		std::vector<std::size_t> ids = std::move(local_counters_.back());
+		local_counters_.pop_back();
+		return ids;
+	}
+
+	/** Ids of counters to initialize as globals. */
+	const std::vector<std::size_t> &global_counters() const
+	{
+		return global_counters_;
+	}
+
+	/** Registers a local variable in the current scope. */
+	void declare(const std::string &name, ValueType type)
+	{
+		assert(!scopes_.empty());
+		scopes_.back()[name] = type;
+	}
+
+	/**
+	 * Updates a type of a visible variable. A block nested in the
+	 * scope of the variable may be not executed or executed
+	 * later (a function body), so the type becomes unknown when
+	 * types differ.
+	 */
+	void assign(const std::string &name, ValueType type)
+	{
+		for (auto scope = scopes_.rbegin(); scope != scopes_.rend();
+		     ++scope) {
+			auto var = scope->find(name);
+			if (var == scope->end())
+				continue;
+			var->second = scope == scopes_.rbegin() ?
+				type : merge_types_(var->second, type);
+			return;
+		}
+		ValueType old_type = lookup(name);
+		globals_[name] = scopes_.size() == 1 ?
+			type : merge_types_(old_type, type);
+	}
+
+	ValueType lookup(const std::string &name) const
+	{
+		for (auto scope = scopes_.rbegin(); scope != scopes_.rend();
+		     ++scope) {
+			auto var = scope->find(name);
+			if (var != scope->end())
+				return var->second;
+		}
+		auto var = globals_.find(name);
+		if (var != globals_.end())
+			return var->second;
+		/*
+		 * Generated names are nil until assigned, other
+		 * names can be builtins.
+		 */
+		if (name.rfind(kDefaultIdent, 0) == 0)
+			return ValueType::kNil;
+		return ValueType::kUnknown;
+	}
+
+	/**
+	 * Returns a type of a variable, when the type cannot change at
+	 * runtime: the variable is a local or a loop variable, and its
+	 * name is never assigned in a program. The type is unknown
+	 * otherwise. Types returned by lookup() are not sound: a type
+	 * of a global is overwritten by a top-level assignment, but
+	 * functions serialized before read the new value, and an
+	 * assignment in a loop body changes a type of a variable,
+	 * that is used before the assignment in the next iteration.
+	 */
+	ValueType fixed_type(const std::string &name) const
+	{
+		if (reassigned_.count(name) != 0)
+			return ValueType::kUnknown;
+		for (auto scope = scopes_.rbegin(); scope != scopes_.rend();
+		     ++scope) {
+			auto var = scope->find(name);
+			if (var != scope->end())
+				return var->second;
+		}
+		return ValueType::kUnknown;
+	}
+
+	/**
+	 * Returns true, when a value of type `type` is valid in
+	 * a position, where a value of type `wanted` is expected.
+	 * A number is converted to a string, e.g. in a concatenation.
+	 */
+	static bool is_compatible(ValueType type, ValueType wanted)
+	{
+		return type == wanted ||
+		       (wanted == ValueType::kString &&
+			type == ValueType::kNumber);
+	}
+
+	/**
+	 * Returns a name of a variable for a position, where a value
+	 * of type `wanted` is expected. The name is returned as is,
+	 * when its type is compatible, otherwise a visible variable
+	 * of the wanted type is chosen by a hash of the name, so the
+	 * choice depends on the input only.
+	 */
+	std::string pick_name(const std::string &name, ValueType wanted)
+	{
+		ValueType type = lookup(name);
+		if (wanted == ValueType::kUnknown ||
+		    type == ValueType::kUnknown || is_compatible(type, wanted))
+			return name;
+
+		std::vector<const std::string *> candidates;
+		for (const auto &scope : scopes_) {
+			for (const auto &var : scope) {
+				if (lookup(var.first) == wanted)
+					candidates.push_back(&var.first);
+			}
+		}
+		for (const auto &var : globals_) {
+			if (lookup(var.first) == wanted)
+				candidates.push_back(&var.first);
+		}
+		if (candidates.empty())
+			return name;
+		size_t idx = std::hash<std::string>{}(name) % candidates.size();
+		return *candidates[idx];
+	}
+
 private:
 
+	ValueType merge_types_(ValueType type1, ValueType type2)
+	{
+		return type1 == type2 ? type1 : ValueType::kUnknown;
+	}
+
 	bool block_type_is_returnable_(BlockType type)
 	{
 		switch (type) {
@@ -350,15 +593,287 @@ private:
 	 * This stack is used to check if `return` is possible.
 	 */
 	std::stack<BlockType> returnable_stack_;
+	std::vector<std::map<std::string, ValueType>> scopes_;
+	std::map<std::string, ValueType> globals_;
+	std::set<std::string> reassigned_;
+	std::vector<std::vector<std::size_t>> local_counters_;
+	std::vector<std::size_t> global_counters_;
+	std::size_t hot_loop_depth_ = 0;
 };
 
+/** A per-thread singleton for serialization context. */
 Context&
 GetContext()
 {
-	static Context context;
+	static thread_local Context context;
 	return context;
 }
 
+using ValueType = Context::ValueType;
+
+/**
+ * Returns a name used by a prefix expression, when the expression
+ * is a variable name, and nullptr otherwise. Unset fields are
+ * serialized as names, see PrefixExpressionToString() and
+ * VariableToString().
+ */
+const Name *
+PrefixExpressionName(const PrefixExpression &prefixexp)
+{
+	using PrefExprType = PrefixExpression::PrefixOneofCase;
+	using VarType = Variable::VarOneofCase;
+	if (prefixexp.prefix_oneof_case() != PrefExprType::kVar &&
+	    prefixexp.prefix_oneof_case() != PrefExprType::PREFIX_ONEOF_NOT_SET)
+		return nullptr;
+	const Variable &var = prefixexp.var();
+	if (var.var_oneof_case() != VarType::kName &&
+	    var.var_oneof_case() != VarType::VAR_ONEOF_NOT_SET)
+		return nullptr;
+	return &var.name();
+}
+
+/**
+ * Serializes a prefix expression in a position, where a value of
+ * type `wanted` is expected, e.g. a function in a call or a table
+ * in an indexing. A variable of a known incompatible type is
+ * replaced by a visible variable of the wanted type.
+ */
+std::string
+PrefixExpressionToStringTyped(const PrefixExpression &prefixexp,
+			      ValueType wanted)
+{
+	const Name *name = PrefixExpressionName(prefixexp);
+	if (name == nullptr)
+		return PrefixExpressionToString(prefixexp);
+	return GetContext().pick_name(NameToString(*name), wanted);
+}
+
+std::string
+ExpressionToStringTyped(const Expression &expr, ValueType wanted)
+{
+	if (expr.expr_oneof_case() == Expression::ExprOneofCase::kPrefixexp)
+		return PrefixExpressionToStringTyped(expr.prefixexp(), wanted);
+	return ExpressionToString(expr);
+}
+
+/**
+ * Returns a guard function from preamble_lite.lua, that converts
+ * any value to a value of type `type`.
+ */
+const std::string &
+GuardName(ValueType type)
+{
+	static const std::string kNoGuard;
+	switch (type) {
+	case ValueType::kNumber:
+		return kNumberWrapperName;
+	case ValueType::kString:
+		return kStringWrapperName;
+	case ValueType::kTable:
+		return kTableWrapperName;
+	case ValueType::kFunction:
+		return kFunctionWrapperName;
+	default:
+		return kNoGuard;
+	}
+}
+
+/**
+ * Wraps a serialized expression `expr_str` of type `type` by
+ * a guard, when preamble_lite.lua is used and the type is not
+ * known to be `wanted`. A number is accepted as a string.
+ */
+std::string
+GuardExpression(const std::string &expr_str, ValueType type,
+		ValueType wanted)
+{
+	if (!GetOptions().preamble_lite ||
+	    Context::is_compatible(type, wanted))
+		return expr_str;
+	const std::string &guard = GuardName(wanted);
+	if (guard.empty())
+		return expr_str;
+	return guard + "(" + expr_str + ")";
+}
+
+std::string
+NumberWrappedExpressionToString(const Expression &expr)
+{
+	std::string retval;
+	retval += kNumberWrapperName;
+	retval += "(";
+	retval += ExpressionToStringTyped(expr, ValueType::kNumber);
+	retval += ")";
+
+	return retval;
+}
+
+bool
+IsArithmeticOperator(const std::string &op)
+{
+	return op == "+" || op == "-" || op == "*" || op == "/" ||
+	       op == "//" || op == "^" || op == "%" || op == "&" ||
+	       op == "|" || op == "~" || op == "<<" || op == ">>";
+}
+
+bool
+IsComparisonOperator(const std::string &op)
+{
+	return op == "<" || op == ">" || op == "<=" || op == ">=" ||
+	       op == "==" || op == "~=";
+}
+
+/** Returns a type of operands expected by a binary operator. */
+ValueType
+BinaryOperandType(const std::string &op)
+{
+	if (IsArithmeticOperator(op))
+		return ValueType::kNumber;
+	if (op == "<" || op == ">" || op == "<=" || op == ">=")
+		return ValueType::kNumber;
+	if (op == "..")
+		return ValueType::kString;
+	return ValueType::kUnknown;
+}
+
+/** Returns a type of operand expected by a unary operator. */
+ValueType
+UnaryOperandType(const std::string &op)
+{
+	if (op == "-" || op == "~")
+		return ValueType::kNumber;
+	if (op == "#")
+		return ValueType::kTable;
+	return ValueType::kUnknown;
+}
+
+/**
+ * Returns a type of an expression value. Metamethods installed by
+ * preamble.lua make arithmetic on any values return numbers.
+ * A type of a variable is returned by Context::fixed_type(), when
+ * `is_fixed` is true, and by Context::lookup() otherwise.
+ */
+ValueType
+ExpressionType(const Expression &expr, bool is_fixed = false)
+{
+	using ExprType = Expression::ExprOneofCase;
+	switch (expr.expr_oneof_case()) {
+	case ExprType::kNil:
+		return ValueType::kNil;
+	case ExprType::kFalse:
+	case ExprType::kTrue:
+		return ValueType::kBoolean;
+	case ExprType::kNumber:
+		return ValueType::kNumber;
+	case ExprType::kEllipsis:
+		return ValueType::kUnknown;
+	case ExprType::kFunction:
+		return ValueType::kFunction;
+	case ExprType::kPrefixexp: {
+		const Name *name = PrefixExpressionName(expr.prefixexp());
+		if (name == nullptr)
+			return ValueType::kUnknown;
+		return is_fixed ? GetContext().fixed_type(NameToString(*name)) :
+				  GetContext().lookup(NameToString(*name));
+	}
+	case ExprType::kTableconstructor:
+		return ValueType::kTable;
+	case ExprType::kBinary: {
+		std::string op = BinaryOperatorToString(expr.binary().binop());
+		if (IsArithmeticOperator(op))
+			return ValueType::kNumber;
+		if (IsComparisonOperator(op))
+			return ValueType::kBoolean;
+		if (op == "..")
+			return ValueType::kString;
+		return ValueType::kUnknown;
+	}
+	case ExprType::kUnary: {
+		std::string op = UnaryOperatorToString(expr.unary().unop());
+		if (op == "not ")
+			return ValueType::kBoolean;
+		return ValueType::kNumber;
+	}
+	case ExprType::kStr:
+	default:
+		/* A string is serialized by default. */
+		return ValueType::kString;
+	}
+}
+
+/**
+ * Returns a type of a prefix expression serialized to
+ * `prefixexp_str`, when the type cannot change at runtime, see
+ * Context::fixed_type(). A variable name can be replaced by
+ * PrefixExpressionToStringTyped().
+ */
+ValueType
+PrefixExpressionFixedType(const PrefixExpression &prefixexp,
+			  const std::string &prefixexp_str)
+{
+	if (PrefixExpressionName(prefixexp) != nullptr)
+		return GetContext().fixed_type(prefixexp_str);
+	if (prefixexp.prefix_oneof_case() ==
+	    PrefixExpression::PrefixOneofCase::kExp)
+		return ExpressionType(prefixexp.exp(), true);
+	return ValueType::kUnknown;
+}
+
+/**
+ * Serializes a prefix expression in a position, where a value of
+ * type `wanted` is expected, the expression is guarded with
+ * preamble_lite.lua.
+ */
+std::string
+PrefixExpressionToStringGuarded(const PrefixExpression &prefixexp,
+				ValueType wanted)
+{
+	std::string prefixexp_str = PrefixExpressionToStringTyped(prefixexp,
+								  wanted);
+	return GuardExpression(prefixexp_str,
+			       PrefixExpressionFixedType(prefixexp,
+							 prefixexp_str),
+			       wanted);
+}
+
+std::string
+ExpressionToStringGuarded(const Expression &expr, ValueType wanted)
+{
+	if (expr.expr_oneof_case() == Expression::ExprOneofCase::kPrefixexp)
+		return PrefixExpressionToStringGuarded(expr.prefixexp(),
+						       wanted);
+	return GuardExpression(ExpressionToString(expr),
+			       ExpressionType(expr, true), wanted);
+}
+
+/**
+ * Returns types of values of an expression list adjusted to
+ * `num_values` values. A function call or a vararg expression
+ * in the last position expands to unknown values, missed values
+ * are nil otherwise.
+ */
+std::vector<ValueType>
+ExpressionListTypes(const ExpressionList &explist, size_t num_values)
+{
+	std::vector<ValueType> types;
+	for (int i = 0; i < explist.expressions_size(); ++i)
+		types.push_back(ExpressionType(explist.expressions(i)));
+	const Expression &last = explist.explast();
+	types.push_back(ExpressionType(last));
+
+	using ExprType = Expression::ExprOneofCase;
+	using PrefExprType = PrefixExpression::PrefixOneofCase;
+	bool is_multi = last.expr_oneof_case() == ExprType::kEllipsis ||
+		(last.expr_oneof_case() == ExprType::kPrefixexp &&
+		 last.prefixexp().prefix_oneof_case() ==
+			PrefExprType::kFunctioncall);
+	if (is_multi)
+		types.back() = ValueType::kUnknown;
+	types.resize(num_values, is_multi ? ValueType::kUnknown :
+					    ValueType::kNil);
+	return types;
+}
+
 /**
  * Block may be placed not only in a cycle, so specially for cycles
  * there is a function that will add a break condition and a
@@ -367,8 +882,10 @@ GetContext()
 std::string
 BlockToStringCycleProtected(const Block &block)
 {
+	GetContext().scope_in();
 	std::string retval = GetContext().get_next_block_setup();
 	retval += ChunkToString(block.chunk());
+	GetContext().scope_out();
 	return retval;
 }
 
@@ -386,6 +903,31 @@ DoBlockToStringCycleProtected(const DoBlock &block)
 	return retval;
 }
 
+/** Parameters are visible in a function body, types are unknown. */
+void
+DeclareParameters(const FuncBody::ParList &parlist)
+{
+	using ParListType = FuncBody::ParList::ParlistOneofCase;
+	if (parlist.parlist_oneof_case() == ParListType::kEllipsis)
+		return;
+	const NameList &namelist = parlist.namelist().namelist();
+	GetContext().declare(NameToString(namelist.firstname()),
+			     ValueType::kUnknown);
+	for (int i = 0; i < namelist.names_size(); ++i)
+		GetContext().declare(NameToString(namelist.names(i)),
+				     ValueType::kUnknown);
+}
+
+/** Returns `local <counter_name> = 0` for every counter. */
+std::string
+LocalCountersToString(const std::vector<std::size_t> &ids)
+{
+	std::string retval;
+	for (std::size_t id : ids)
+		retval += "local " + GetCounterName(id) + " = 0\n";
+	return retval;
+}
+
 /**
  * FuncBody may contain recursive calls, so for all function bodies,
  * there is a function that adds a return condition and a counter
@@ -394,16 +936,23 @@ DoBlockToStringCycleProtected(const DoBlock &block)
 std::string
 FuncBodyToStringReqProtected(const FuncBody &body)
 {
+	GetContext().scope_in();
 	std::string body_str = "( ";
 	if (body.has_parlist()) {
 		body_str += ParListToString(body.parlist());
+		DeclareParameters(body.parlist());
 	}
 	body_str += " )\n\t";
 
+	/* The counter of the body belongs to the enclosing function. */
 	body_str += GetContext().get_next_block_setup();
 
-	body_str += BlockToString(body.block());
+	GetContext().counters_in();
+	std::string block_str = BlockToString(body.block());
+	body_str += LocalCountersToString(GetContext().counters_out());
+	body_str += block_str;
 	body_str += "end\n";
+	GetContext().scope_out();
 	return body_str;
 }
 
@@ -509,7 +1058,10 @@ ConvertToStringDefault(const std::string &s, bool is_identifier = false)
 
 PROTO_TOSTRING(Block, block)
 {
-	return ChunkToString(block.chunk());
+	GetContext().scope_in();
+	std::string block_str = ChunkToString(block.chunk());
+	GetContext().scope_out();
+	return block_str;
 }
 
 PROTO_TOSTRING(Chunk, chunk)
@@ -646,6 +1198,21 @@ PROTO_TOSTRING(AssignmentList, assignmentlist)
 {
 	std::string list_str = VariableListToString(assignmentlist.varlist());
 	list_str += " = " + ExpressionListToString(assignmentlist.explist());
+
+	/* Track types of assigned variables. */
+	const AssignmentList::VariableList &varlist = assignmentlist.varlist();
+	std::vector<const Variable *> vars = { &varlist.var() };
+	for (int i = 0; i < varlist.vars_size(); ++i)
+		vars.push_back(&varlist.vars(i));
+	std::vector<ValueType> types = ExpressionListTypes(
+		assignmentlist.explist(), vars.size());
+	for (size_t i = 0; i < vars.size(); ++i) {
+		using VarType = Variable::VarOneofCase;
+		if (vars[i]->var_oneof_case() != VarType::kName &&
+		    vars[i]->var_oneof_case() != VarType::VAR_ONEOF_NOT_SET)
+			continue;
+		GetContext().assign(NameToString(vars[i]->name()), types[i]);
+	}
 	return list_str;
 }
 
@@ -695,16 +1262,53 @@ NESTED_PROTO_TOSTRING(Args, args, FunctionCall)
 
 NESTED_PROTO_TOSTRING(PrefixArgs, prefixargs, FunctionCall)
 {
-	std::string prefixargs_str = PrefixExpressionToString(
-		prefixargs.prefixexp());
+	std::string prefixargs_str = PrefixExpressionToStringGuarded(
+		prefixargs.prefixexp(), ValueType::kFunction);
 	prefixargs_str += " " + ArgsToString(prefixargs.args());
 	return prefixargs_str;
 }
 
+/**
+ * Serializes a method call `prefixexp:name args` to
+ * `method_call(prefixexp, 'name', args)`, the function defined
+ * in preamble_lite.lua calls a method of any value.
+ */
+std::string
+MethodCallToString(const FunctionCall::PrefixNamedArgs &prefixnamedargs)
+{
+	std::string call_str = kMethodCallName + "(";
+	call_str += PrefixExpressionToStringTyped(prefixnamedargs.prefixexp(),
+						  ValueType::kTable);
+	call_str += ", '" + NameToString(prefixnamedargs.name()) + "'";
+
+	const FunctionCall::Args &args = prefixnamedargs.args();
+	using ArgsType = FunctionCall::Args::ArgsOneofCase;
+	switch (args.args_oneof_case()) {
+	case ArgsType::kExplist:
+		if (args.explist().has_explist())
+			call_str += ", " + ExpressionListToString(
+				args.explist().explist());
+		break;
+	case ArgsType::kStr:
+		call_str += ", '" + ConvertToStringDefault(args.str()) + "'";
+		break;
+	default:
+		/* See ArgsToString(). */
+		call_str += ", " + TableConstructorToString(
+			args.tableconstructor());
+		break;
+	}
+	call_str += ")";
+	return call_str;
+}
+
 NESTED_PROTO_TOSTRING(PrefixNamedArgs, prefixnamedargs, FunctionCall)
 {
-	std::string predixnamedargs_str = PrefixExpressionToString(
-		prefixnamedargs.prefixexp());
+	if (GetOptions().preamble_lite)
+		return MethodCallToString(prefixnamedargs);
+
+	std::string predixnamedargs_str = PrefixExpressionToStringTyped(
+		prefixnamedargs.prefixexp(), ValueType::kTable);
 	predixnamedargs_str += ":" + NameToString(prefixnamedargs.name());
 	predixnamedargs_str += " " + ArgsToString(prefixnamedargs.args());
 	return predixnamedargs_str;
@@ -778,6 +1382,50 @@ NESTED_PROTO_TOSTRING(ElseIfBlock, elseifblock, IfStatement)
 	return elseifblock_str;
 }
 
+/**
+ * A hot loop of the JIT-stress profile:
+ *
+ * do
+ * local hot_array = {}
+ * for <name> = 1, <jit_trip_count> do
+ * hot_array[<name>] = <name> * always_number(<start>) +
+ *     always_number(<stop>)
+ * <block>
+ * end
+ * end
+ *
+ * Bounds are constants, so the loop is not protected by a counter
+ * and is executed long enough to be recorded by the JIT compiler.
+ * A store to the array and the arithmetic are executed on every
+ * iteration, nested hot loops produce side traces.
+ */
+std::string
+HotForCycleNameToString(const ForCycleName &forcyclename)
+{
+	std::string name = NameToString(forcyclename.name());
+	std::string retval = "do\nlocal ";
+	retval += kHotArrayName;
+	retval += " = {}\nfor " + name + " = 1, ";
+	retval += std::to_string(GetOptions().jit_trip_count);
+	retval += " do\n";
+
+	GetContext().scope_in();
+	GetContext().declare(name, ValueType::kNumber);
+	retval += kHotArrayName;
+	retval += "[" + name + "] = " + name + " * ";
+	retval += NumberWrappedExpressionToString(forcyclename.startexp());
+	retval += " + ";
+	retval += NumberWrappedExpressionToString(forcyclename.stopexp());
+	retval += "\n";
+	GetContext().hot_loop_in();
+	retval += BlockToString(forcyclename.doblock().block());
+	GetContext().hot_loop_out();
+	GetContext().scope_out();
+
+	retval += "end\nend\n";
+	return retval;
+}
+
 /**
  * ForCycleName clause.
  * TODO: In 'for i = start, stop, step' construction start, stop, step
@@ -788,6 +1436,12 @@ PROTO_TOSTRING(ForCycleName, forcyclename)
 {
 	GetContext().step_in(Context::BlockType::kBreakable);
 
+	if (forcyclename.hot() && GetContext().hot_loop_is_possible()) {
+		std::string hot_loop_str = HotForCycleNameToString(forcyclename);
+		GetContext().step_out();
+		return hot_loop_str;
+	}
+
 	std::string forcyclename_str = "for ";
 	forcyclename_str += NameToString(forcyclename.name());
 	forcyclename_str += " = ";
@@ -802,13 +1456,43 @@ PROTO_TOSTRING(ForCycleName, forcyclename)
 			forcyclename.stepexp());
 
 	forcyclename_str += " ";
+	GetContext().scope_in();
+	GetContext().declare(NameToString(forcyclename.name()),
+			     ValueType::kNumber);
 	forcyclename_str += DoBlockToStringCycleProtected(
 		forcyclename.doblock());
+	GetContext().scope_out();
 
 	GetContext().step_out();
 	return forcyclename_str;
 }
 
+/**
+ * The first expression in a generic for is an iterator function,
+ * it is guarded with preamble_lite.lua.
+ */
+std::string
+IteratorExpressionListToString(const ExpressionList &explist)
+{
+	if (!GetOptions().preamble_lite)
+		return ExpressionListToString(explist);
+
+	std::string explist_str;
+	for (int i = 0; i < explist.expressions_size(); ++i) {
+		explist_str += i == 0 ?
+			ExpressionToStringGuarded(explist.expressions(i),
+						  ValueType::kFunction) :
+			ExpressionToString(explist.expressions(i));
+		explist_str += ", ";
+	}
+	explist_str += explist.expressions_size() == 0 ?
+		ExpressionToStringGuarded(explist.explast(),
+					  ValueType::kFunction) :
+		ExpressionToString(explist.explast());
+	explist_str += " ";
+	return explist_str;
+}
+
 /**
  * ForCycleList clause.
  */
@@ -819,10 +1503,19 @@ PROTO_TOSTRING(ForCycleList, forcyclelist)
 	std::string forcyclelist_str = "for ";
 	forcyclelist_str += NameListToString(forcyclelist.names());
 	forcyclelist_str += " in ";
-	forcyclelist_str += ExpressionListToString(forcyclelist.expressions());
+	forcyclelist_str += IteratorExpressionListToString(
+		forcyclelist.expressions());
 	forcyclelist_str += " ";
+	GetContext().scope_in();
+	const NameList &names = forcyclelist.names();
+	GetContext().declare(NameToString(names.firstname()),
+			     ValueType::kUnknown);
+	for (int i = 0; i < names.names_size(); ++i)
+		GetContext().declare(NameToString(names.names(i)),
+				     ValueType::kUnknown);
 	forcyclelist_str += DoBlockToStringCycleProtected(
 		forcyclelist.doblock());
+	GetContext().scope_out();
 
 	GetContext().step_out();
 	return forcyclelist_str;
@@ -835,6 +1528,12 @@ PROTO_TOSTRING(Function, func)
 {
 	GetContext().step_in(GetFuncBodyType(func.body()));
 
+	/* A function can be called recursively in its body. */
+	const Function::FuncName &funcname = func.name();
+	if (funcname.names_size() == 0 && !funcname.has_lastname())
+		GetContext().assign(NameToString(funcname.firstname()),
+				    ValueType::kFunction);
+
 	std::string func_str = "function ";
 	func_str += FuncNameToString(func.name());
 	func_str += FuncBodyToStringReqProtected(func.body());
@@ -893,6 +1592,10 @@ PROTO_TOSTRING(LocalFunc, localfunc)
 {
 	GetContext().step_in(GetFuncBodyType(localfunc.funcbody()));
 
+	/* A local function can be called recursively in its body. */
+	GetContext().declare(NameToString(localfunc.name()),
+			     ValueType::kFunction);
+
 	std::string localfunc_str = "local function ";
 	localfunc_str += NameToString(localfunc.name());
 	localfunc_str += " ";
@@ -913,6 +1616,17 @@ PROTO_TOSTRING(LocalNames, localnames)
 	if (localnames.has_explist())
 		localnames_str += " = " + ExpressionListToString(
 			localnames.explist());
+
+	/* Locals are visible after the statement. */
+	const NameList &namelist = localnames.namelist();
+	std::vector<const Name *> names = { &namelist.firstname() };
+	for (int i = 0; i < namelist.names_size(); ++i)
+		names.push_back(&namelist.names(i));
+	std::vector<ValueType> types(names.size(), ValueType::kNil);
+	if (localnames.has_explist())
+		types = ExpressionListTypes(localnames.explist(), names.size());
+	for (size_t i = 0; i < names.size(); ++i)
+		GetContext().declare(NameToString(*names[i]), types[i]);
 	return localnames_str;
 }
 
@@ -983,16 +1697,16 @@ PROTO_TOSTRING(Variable, var)
 
 NESTED_PROTO_TOSTRING(IndexWithExpression, indexexpr, Variable)
 {
-	std::string indexexpr_str = PrefixExpressionToString(
-		indexexpr.prefixexp());
+	std::string indexexpr_str = PrefixExpressionToStringGuarded(
+		indexexpr.prefixexp(), ValueType::kTable);
 	indexexpr_str += "[" + ExpressionToString(indexexpr.exp()) + "]";
 	return indexexpr_str;
 }
 
 NESTED_PROTO_TOSTRING(IndexWithName, indexname, Variable)
 {
-	std::string indexname_str = PrefixExpressionToString(
-		indexname.prefixexp());
+	std::string indexname_str = PrefixExpressionToStringGuarded(
+		indexname.prefixexp(), ValueType::kTable);
 	std::string idx_str = ConvertToStringDefault(indexname.name(), true);
 	/* Prevent using reserved keywords as indices. */
 	if (KReservedLuaKeywords.find(idx_str) != KReservedLuaKeywords.end()) {
@@ -1060,15 +1774,20 @@ NESTED_PROTO_TOSTRING(AnonFunc, func, Expression)
 
 NESTED_PROTO_TOSTRING(ExpBinaryOpExp, binary, Expression)
 {
-	std::string leftexp_str = ExpressionToString(binary.leftexp());
 	std::string binop_str = BinaryOperatorToString(binary.binop());
-	std::string rightexp_str = ExpressionToString(binary.rightexp());
+	ValueType operand_type = BinaryOperandType(binop_str);
+	std::string leftexp_str;
+	std::string rightexp_str;
 
 	std::string binary_str;
 	if (binop_str == "<" ||
 	    binop_str == ">" ||
 	    binop_str == "<=" ||
 	    binop_str == ">=") {
+		leftexp_str = ExpressionToStringTyped(binary.leftexp(),
+						      operand_type);
+		rightexp_str = ExpressionToStringTyped(binary.rightexp(),
+						       operand_type);
 		binary_str = kBinOpWrapperName;
 		binary_str += "(" + leftexp_str;
 		binary_str += ", '" + binop_str + "', ";
@@ -1076,6 +1795,11 @@ NESTED_PROTO_TOSTRING(ExpBinaryOpExp, binary, Expression)
 		return binary_str;
 	}
 
+	/* Arithmetic and concatenation operands are guarded. */
+	leftexp_str = ExpressionToStringGuarded(binary.leftexp(),
+						operand_type);
+	rightexp_str = ExpressionToStringGuarded(binary.rightexp(),
+						 operand_type);
 	binary_str = leftexp_str;
 	binary_str += " " + binop_str + " ";
 	binary_str += rightexp_str;
@@ -1085,13 +1809,22 @@ NESTED_PROTO_TOSTRING(ExpBinaryOpExp, binary, Expression)
 
 NESTED_PROTO_TOSTRING(UnaryOpExp, unary, Expression)
 {
-	std::string unary_str = UnaryOperatorToString(unary.unop());
+	std::string unop_str = UnaryOperatorToString(unary.unop());
 	/*
 	 * Add a whitespace before an expression with unary minus,
 	 * otherwise double hyphen comments the following code
 	 * and it breaks generated programs syntactically.
 	 */
-	unary_str += " " + ExpressionToString(unary.exp());
+	std::string unary_str = unop_str + " ";
+	ValueType operand_type = UnaryOperandType(unop_str);
+	/*
+	 * A length of a string is valid too, a string variable is
+	 * not replaced by a table variable and is guarded as
+	 * a string.
+	 */
+	if (unop_str == "#" && ExpressionType(unary.exp()) == ValueType::kString)
+		operand_type = ValueType::kString;
+	unary_str += ExpressionToStringGuarded(unary.exp(), operand_type);
 	return unary_str;
 }
 
@@ -1271,23 +2004,108 @@ PROTO_TOSTRING(Name, name)
 	return ident;
 }
 
+/**
+ * Collects names of variables, that are assigned in a message:
+ * targets of assignments and names of function statements.
+ */
+void
+CollectAssignedNames(const google::protobuf::Message &message,
+		     std::set<std::string> *names)
+{
+	using google::protobuf::FieldDescriptor;
+
+	const google::protobuf::Descriptor *descriptor =
+		message.GetDescriptor();
+	if (descriptor == AssignmentList::VariableList::descriptor()) {
+		const auto &varlist =
+			static_cast<const AssignmentList::VariableList &>(message);
+		std::vector<const Variable *> vars = { &varlist.var() };
+		for (int i = 0; i < varlist.vars_size(); ++i)
+			vars.push_back(&varlist.vars(i));
+		for (const Variable *var : vars) {
+			using VarType = Variable::VarOneofCase;
+			if (var->var_oneof_case() == VarType::kName ||
+			    var->var_oneof_case() == VarType::VAR_ONEOF_NOT_SET)
+				names->insert(NameToString(var->name()));
+		}
+	} else if (descriptor == Function::FuncName::descriptor()) {
+		const auto &funcname =
+			static_cast<const Function::FuncName &>(message);
+		if (funcname.names_size() == 0 && !funcname.has_lastname())
+			names->insert(NameToString(funcname.firstname()));
+	}
+
+	const google::protobuf::Reflection *reflection =
+		message.GetReflection();
+	std::vector<const FieldDescriptor *> fields;
+	reflection->ListFields(message, &fields);
+	for (const FieldDescriptor *field : fields) {
+		if (field->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE)
+			continue;
+		if (!field->is_repeated()) {
+			CollectAssignedNames(reflection->GetMessage(message,
+								    field),
+					     names);
+			continue;
+		}
+		for (int i = 0; i < reflection->FieldSize(message, field); ++i)
+			CollectAssignedNames(reflection->GetRepeatedMessage(
+				message, field, i), names);
+	}
+}
+
 } /* namespace */
 
 std::string
-MainBlockToString(const Block &block)
+MainBlockToString(const Block &block, const SerializerOptions &options)
 {
 	GetCounterIdProvider().clean();
+	GetContext().clean_globals();
+	GetOptions() = options;
+	if (options.preamble_lite) {
+		std::set<std::string> assigned_names;
+		CollectAssignedNames(block, &assigned_names);
+		GetContext().set_reassigned(std::move(assigned_names));
+	}
 
+	GetContext().counters_in();
 	std::string block_str = BlockToString(block);
-	std::string retval = preamble_lua;
+	std::vector<std::size_t> local_ids = GetContext().counters_out();
+	std::string retval;
+	if (!options.preamble_in_state)
+		retval = options.preamble_lite ? preamble_lite_lua :
+						 preamble_lua;
 
-	for (size_t i = 0; i < GetCounterIdProvider().count(); ++i) {
-		retval += GetCounterName(i);
+	for (std::size_t id : GetContext().global_counters()) {
+		retval += GetCounterName(id);
 		retval += " = 0\n";
 	}
+	retval += LocalCountersToString(local_ids);
 	retval += block_str;
 
 	return retval;
 }
 
+std::string
+PreambleToString(const SerializerOptions &options)
+{
+	std::vector<std::string> names = {
+		kNumberWrapperName,
+		kBinOpWrapperName,
+		kNotNaNAndNilWrapperName,
+	};
+	if (options.preamble_lite) {
+		names.push_back(kStringWrapperName);
+		names.push_back(kTableWrapperName);
+		names.push_back(kFunctionWrapperName);
+		names.push_back(kMethodCallName);
+	}
+	std::string retval = options.preamble_lite ? preamble_lite_lua :
+						     preamble_lua;
+	for (const std::string &name : names)
+		retval += "_G." + name + " = " + name + "\n";
+
+	return retval;
+}
+
 } /* namespace luajit_fuzzer */
@@ -22,6 +22,22 @@ namespace luajit_fuzzer {
  * kMinNumber - lower bound for all generated numbers.
  * kMaxStrLength - upper bound for generating string literals and identifiers.
  * kMaxIdentifiers - max number of unique generated identifiers.
+ * kMaxLocalCounters - max number of counters declared as locals in
+ * a function with `local_counters`, a number of locals in a Lua
+ * function is limited.
+ * kMaxLocalCountersDepth - with `local_counters` counters are
+ * locals in the main chunk and in functions with a nesting depth
+ * less than kMaxLocalCountersDepth, deeper functions use global
+ * counters. A local counter is reset on every call of a function,
+ * so a loop or a function body protected by a counter is executed
+ * at most kMaxCounterValue ^ kMaxLocalCountersDepth times in total
+ * (a trip count is used instead of kMaxCounterValue for loops with
+ * `jit_trip_count`).
+ * kJitStressTripCount - default number of iterations of hot loops
+ * with `jit_trip_count`, it is larger than a default number of
+ * iterations (56) after which LuaJIT starts to record a trace.
+ * kMaxHotLoopDepth - max lexical nesting depth of hot loops, it
+ * bounds a number of iterations by a power of a trip count.
  * kDefaultIdent - default name for identifier.
  * Default values were chosen arbitrary but not too big for better readability
  * of generated code samples.
@@ -31,8 +47,56 @@ constexpr double kMaxNumber = 1000.0;
 constexpr double kMinNumber = -1000.0;
 constexpr size_t kMaxStrLength = 20;
 constexpr size_t kMaxIdentifiers = 10;
+constexpr size_t kMaxLocalCounters = 32;
+constexpr size_t kMaxLocalCountersDepth = 2;
+constexpr size_t kJitStressTripCount = 100;
+constexpr size_t kMaxHotLoopDepth = 2;
 constexpr char kDefaultIdent[] = "Name";
 
+/**
+ * Serializer options:
+ * preamble_lite - use preamble_lite.lua instead of preamble.lua.
+ * The preamble does not set metatables for strings, numbers, nil,
+ * booleans and functions, so operations on these values use fast
+ * paths in the VM. Operands with types unknown to the serializer
+ * are wrapped by guard functions instead.
+ * local_counters - declare counters as locals of an enclosing
+ * function instead of globals, so loops do not access a global
+ * table. A loop counter is declared in a function with the loop,
+ * so the loop is limited per function call. A counter of
+ * a function body is declared in the enclosing function and is an
+ * upvalue in the body, so recursion is limited per a call of the
+ * enclosing function. Deeply nested functions use global
+ * counters, see kMaxLocalCountersDepth.
+ * jit_trip_count - a JIT-stress profile, when it is not zero.
+ * Numeric for loops marked by a field `hot`, up to
+ * kMaxHotLoopDepth nested, are hot loops
+ * `for i = 1, jit_trip_count`, that store an arithmetic expression
+ * to a table array on every iteration, and other loops are limited
+ * by `jit_trip_count` iterations instead of kMaxCounterValue, so
+ * the loops are long enough to be compiled by LuaJIT and nested
+ * loops produce side traces. Other numeric for loops keep their
+ * bounds and steps, e.g. negative, fractional and zero steps.
+ * preamble_in_state - a preamble is not prepended to a program,
+ * it is executed once in a Lua state, that executes programs, see
+ * PreambleToString().
+ */
+struct SerializerOptions {
+	bool preamble_lite = false;
+	bool local_counters = false;
+	std::size_t jit_trip_count = 0;
+	bool preamble_in_state = false;
+};
+
+/**
+ * Returns a preamble for programs serialized with
+ * `preamble_in_state`. Functions used by programs are locals in
+ * the preamble, they are assigned to globals with the same names,
+ * so programs loaded as separate chunks refer to them.
+ */
+std::string
+PreambleToString(const SerializerOptions &options);
+
 /**
  * Entry point for the serializer. Generates a Lua program from a
  * protobuf message with all counter initializations placed above
@@ -41,6 +105,7 @@ constexpr char kDefaultIdent[] = "Name";
  * recursions.
  */
 std::string
-MainBlockToString(const lua_grammar::Block &block);
+MainBlockToString(const lua_grammar::Block &block,
+		  const SerializerOptions &options = SerializerOptions());
 
 } /* namespace luajit_fuzzer */
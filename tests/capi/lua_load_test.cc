@@ -23,13 +23,13 @@ extern "C" {
 
 typedef struct {
 	FuzzedDataProvider *fdp;
+	char *buf;
 } dt;
 
 static const char *
 Reader(lua_State *L, void *data, size_t *size)
 {
 	dt *test_data = (dt *)data;
-	static char *buf = NULL;
 
 	FuzzedDataProvider *fdp = test_data->fdp;
 	uint8_t max_str_size = fdp->ConsumeIntegral<uint8_t>();
@@ -38,12 +38,12 @@ Reader(lua_State *L, void *data, size_t *size)
 	auto str = fdp->ConsumeRandomLengthString(max_str_size);
 	*size = str.size();
 
-	free(buf);
-	buf = (char *)malloc(*size);
-	assert(buf);
-	memcpy(buf, str.c_str(), *size);
+	free(test_data->buf);
+	test_data->buf = (char *)malloc(*size);
+	assert(test_data->buf);
+	memcpy(test_data->buf, str.c_str(), *size);
 
-	return buf;
+	return test_data->buf;
 }
 
 extern "C" int
@@ -58,6 +58,7 @@ LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
 	FuzzedDataProvider fdp(data, size);
 	dt test_data;
 	test_data.fdp = &fdp;
+	test_data.buf = NULL;
 
 #if LUA_VERSION_NUM == 501
 	int res = lua_load(L, Reader, &test_data, "libFuzzer");
@@ -68,6 +69,7 @@ LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
 	if (res == LUA_OK) {
 		lua_pcall(L, 0, 0, 0);
 	}
+	free(test_data.buf);
 
 	lua_settop(L, 0);
 	lua_close(L);
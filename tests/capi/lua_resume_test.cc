@@ -0,0 +1,156 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright 2025, Sergey Bronnikov.
+ */
+
+/**
+ * The test creates thousands of Lua threads by `lua_newthread()`,
+ * every thread runs a Lua function with a fuzzed stack depth and
+ * a fuzzed number of yields. Threads are resumed by
+ * `lua_resume()` in rounds in a fuzzed order, a full garbage
+ * collection is triggered between rounds, so the garbage
+ * collector traverses stacks of suspended threads.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif /* defined(__cplusplus) */
+
+#include "lua.h"
+#include "lualib.h"
+#include "lauxlib.h"
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif /* defined(__cplusplus) */
+
+#include <fuzzer/FuzzedDataProvider.h>
+
+#define MAX_THREADS 10000
+#define MAX_DEPTH 64
+#define MAX_YIELDS 16
+
+/*
+ * The function is executed by every thread, it calls itself
+ * `depth` times and yields `num_yields` times on the top of the
+ * stack. Recursive calls are not tail calls, so stack frames are
+ * alive while a thread is suspended.
+ */
+static const char coro_body[] =
+	"local function body(depth, num_yields)\n"
+	"	if depth > 0 then\n"
+	"		local res = body(depth - 1, num_yields)\n"
+	"		return res\n"
+	"	end\n"
+	"	for i = 1, num_yields do\n"
+	"		coroutine.yield(i)\n"
+	"	end\n"
+	"	return num_yields\n"
+	"end\n"
+	"return body\n";
+
+struct coro {
+	lua_State *co;
+	int num_yields;
+	int num_resumes;
+	bool is_dead;
+};
+
+static int
+__lua_resume(lua_State *L, lua_State *co, int nargs, int *nres)
+{
+#if LUA_VERSION_NUM == 501
+	(void)L;
+	int rc = lua_resume(co, nargs);
+	*nres = lua_gettop(co);
+#elif LUA_VERSION_NUM == 502 || LUA_VERSION_NUM == 503
+	int rc = lua_resume(co, L, nargs);
+	*nres = lua_gettop(co);
+#else /* Lua 5.4+ */
+	int rc = lua_resume(co, L, nargs, nres);
+#endif /* LUA_VERSION_NUM */
+	return rc;
+}
+
+extern "C" int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	lua_State *L = luaL_newstate();
+	if (L == NULL)
+		return 0;
+
+	luaL_openlibs(L);
+
+	/* Stack: body. */
+	if (luaL_loadstring(L, coro_body) != LUA_OK ||
+	    lua_pcall(L, 0, 1, 0) != LUA_OK) {
+		lua_close(L);
+		return 0;
+	}
+	/* Stack: body, anchors. Threads are anchored in a table. */
+	lua_newtable(L);
+
+	FuzzedDataProvider fdp(data, size);
+	int num_threads = fdp.ConsumeIntegralInRange<int>(1, MAX_THREADS);
+	struct coro *coros = (struct coro *)calloc(num_threads,
+						   sizeof(*coros));
+	assert(coros);
+	for (int i = 0; i < num_threads; i++) {
+		lua_State *co = lua_newthread(L);
+		lua_rawseti(L, 2, i + 1);
+		lua_pushvalue(L, 1);
+		lua_xmove(L, co, 1);
+		int depth = fdp.ConsumeIntegralInRange<int>(0, MAX_DEPTH);
+		int num_yields = fdp.ConsumeIntegralInRange<int>(0, MAX_YIELDS);
+		lua_pushinteger(co, depth);
+		lua_pushinteger(co, num_yields);
+		coros[i].co = co;
+		coros[i].num_yields = num_yields;
+		coros[i].num_resumes = 0;
+		coros[i].is_dead = false;
+	}
+
+	int num_alive = num_threads;
+	while (num_alive > 0) {
+		for (int i = 0; i < num_threads; i++) {
+			struct coro *c = &coros[i];
+			if (c->is_dead)
+				continue;
+			/*
+			 * A thread is skipped in a round to vary an order
+			 * of resumes, an exhausted data provider returns
+			 * false, so the loop is finite.
+			 */
+			if (fdp.ConsumeBool())
+				continue;
+			int nargs = c->num_resumes == 0 ? 2 : 0;
+			int nres = 0;
+			int rc = __lua_resume(L, c->co, nargs, &nres);
+			if (rc == LUA_YIELD) {
+				assert(nres == 1);
+				c->num_resumes++;
+				assert(lua_tointeger(c->co, -1) == c->num_resumes);
+				lua_pop(c->co, nres);
+				continue;
+			}
+			if (rc == LUA_OK) {
+				assert(c->num_resumes == c->num_yields);
+				assert(lua_tointeger(c->co, -1) == c->num_yields);
+			}
+			c->is_dead = true;
+			num_alive--;
+		}
+		if (fdp.ConsumeBool())
+			lua_gc(L, LUA_GCCOLLECT, 0);
+	}
+	free(coros);
+
+	lua_settop(L, 0);
+	lua_close(L);
+
+	return 0;
+}
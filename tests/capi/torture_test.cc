@@ -679,6 +679,8 @@ __lua_gc(lua_State *L, FuzzedDataProvider *fdp)
 	assert(lua_gettop(L) == top);
 }
 
+#define MAX_HOOK_COUNT 1000
+
 static int hook_mode[] = {
 	0, /* Additional branch in Lua. */
 	LUA_MASKCALL,
@@ -700,8 +702,14 @@ static void
 __lua_sethook(lua_State *L, FuzzedDataProvider *fdp)
 {
 	int top = lua_gettop(L);
-	uint8_t idx = fdp->ConsumeIntegralInRange<uint8_t>(0, ARRAY_SIZE(hook_mode) - 1);
-	lua_sethook(L, Hook, hook_mode[idx], 1);
+	/* A mask is a combination of hook modes. */
+	int mask = 0;
+	for (size_t i = 0; i < ARRAY_SIZE(hook_mode); i++) {
+		if (fdp->ConsumeBool())
+			mask |= hook_mode[i];
+	}
+	int count = fdp->ConsumeIntegralInRange<int>(0, MAX_HOOK_COUNT);
+	lua_sethook(L, Hook, mask, count);
 	assert(lua_gettop(L) == top);
 }
 
@@ -0,0 +1,117 @@
+--[[
+SPDX-License-Identifier: ISC
+Copyright (c) 2023-2025, Sergey Bronnikov.
+
+The script turns a test `<lib>_<func>_test.lua` into a
+micro-benchmark of a function `<lib>.<func>`:
+
+1. A test function `TestOneInput()` is executed with every file
+   in a corpus, assertions are disabled, arguments of every call
+   of the function under test are saved.
+2. The function under test is executed with saved arguments
+   without a test code and libFuzzer, time and memory per call
+   are reported.
+
+Usage: bench.lua <test file> <corpus path>...
+
+The number of rounds is set by an environment variable
+`BENCH_ROUNDS`.
+]]
+
+local luzer = require("luzer")
+local test_lib = require("lib")
+
+local ROUNDS = tonumber(os.getenv("BENCH_ROUNDS")) or 10
+
+local test_path = arg[1]
+if not test_path or not arg[2] then
+    io.stderr:write("Usage: bench.lua <test file> <corpus path>...\n")
+    os.exit(1)
+end
+
+-- Libraries, that have names different from a prefix in a test
+-- name.
+local libs = {
+    bitop = rawget(_G, "bit"),
+    builtin = _G,
+}
+
+-- The function returns a table and a key of a function under
+-- test, e.g. `string` and `format` for `string_format_test.lua`.
+local function func_under_test(test_name)
+    local prefix, func_name = test_name:match("^([^_]+)_(.+)_test$")
+    if not prefix then
+        return nil
+    end
+    local lib = libs[prefix] or rawget(_G, prefix)
+    if type(lib) == "table" and type(rawget(lib, func_name)) == "function" then
+        return lib, func_name
+    end
+    -- Functions loaded by `require()`, e.g. `table.clear`.
+    local module_name = ("%s.%s"):format(prefix, func_name)
+    local ok, func = pcall(require, module_name)
+    if ok and type(func) == "function" then
+        return package.loaded, module_name
+    end
+    return nil
+end
+
+local function corpus_files(paths)
+    local files = {}
+    for _, path in ipairs(paths) do
+        local f = io.popen(("find '%s' -type f"):format(path))
+        for file_path in f:lines() do
+            table.insert(files, file_path)
+        end
+        f:close()
+    end
+    table.sort(files)
+    return files
+end
+
+local test_name = test_path:match("([^/]+)%.lua$")
+local lib, func_name = func_under_test(test_name)
+if not lib then
+    print(("%s: function under test is not found, skipped"):format(test_name))
+    os.exit(0)
+end
+local name = (lib == package.loaded) and func_name or
+             test_name:gsub("_test$", ""):gsub("_", ".", 1)
+
+local corpus_paths = {}
+for i = 2, #arg do
+    table.insert(corpus_paths, arg[i])
+end
+local corpus = corpus_files(corpus_paths)
+
+-- libFuzzer loop is replaced by a function, that saves a test
+-- function.
+local test_one_input
+package.loaded.luzer = setmetatable({
+    Fuzz = function(func)
+        test_one_input = func
+    end,
+}, { __index = luzer })
+
+local func = lib[func_name]
+local calls = {}
+local assert_orig = assert
+lib[func_name] = test_lib.bench_record(func, calls)
+-- `assert()` under test is recorded and is not disabled.
+if lib ~= _G or func_name ~= "assert" then
+    assert = function(...) return ... end
+end
+dofile(test_path)
+assert_orig(test_one_input, "luzer.Fuzz() is not called")
+for _, file_path in ipairs(corpus) do
+    local f = io.open(file_path, "rb")
+    local buf = f:read("*a")
+    f:close()
+    pcall(test_one_input, buf)
+end
+assert = assert_orig
+lib[func_name] = func
+
+local ns_per_op, bytes_per_op = test_lib.bench_calls(func, calls, ROUNDS)
+print(("%s: inputs: %d, calls: %d, ns/op: %.1f, bytes/op: %.1f"):format(
+      name, #corpus, #calls, ns_per_op, bytes_per_op))
@@ -0,0 +1,72 @@
+--[[
+SPDX-License-Identifier: ISC
+Copyright (c) 2023-2025, Sergey Bronnikov.
+
+Micro-benchmark for a function `bitwise_op()` in lib.lua, that is
+used as an oracle in bitop_*_test.lua tests on PUC Rio Lua 5.3+.
+The function compiles bitwise operations once, the benchmark
+compares it with a compilation of a chunk on every call.
+
+The number of iterations is set by an environment variable
+`BENCH_ITERATIONS`.
+]]
+
+local test_lib = require("lib")
+
+if test_lib.lua_current_version_lt_than(5, 3) then
+    print("Bitwise operators are not supported, skipped.")
+    os.exit(0)
+end
+
+local ITERATIONS = tonumber(os.getenv("BENCH_ITERATIONS")) or 10000
+
+-- A previous implementation of `bitwise_op()`, that builds
+-- and loads a chunk on every call.
+local function bitwise_op_load(op_name)
+    return function(...)
+        local n = select("#", ...)
+        local chunk
+        if n == 1 then
+            local x = ...
+            chunk = ("return %s %d"):format(op_name, x)
+        else
+            local op_name_ws = (" %s "):format(op_name)
+            chunk = "return " .. table.concat({...}, op_name_ws)
+        end
+        return assert(load(chunk))()
+    end
+end
+
+local unpack = unpack or table.unpack
+
+local function ops_per_sec(op, args)
+    local start = os.clock()
+    for _ = 1, ITERATIONS do
+        op(unpack(args))
+    end
+    local elapsed = os.clock() - start
+    return elapsed > 0 and ITERATIONS / elapsed or math.huge
+end
+
+local cases = {
+    { "~", { 0x5a5a } },
+    { "&", { 0x7fff, -3 } },
+    { "|", { 0x0f0f, 0x7070 } },
+    { "~", { 0x7fffffff, 0x12345678 } },
+    { "<<", { 1, 31 } },
+    { ">>", { -1, 7 } },
+    { "&", { -1, 0x7ffffff, 0xffff, 0xff0, 0x3f0, 0x1f0, 0xf0, 0x70 } },
+}
+
+for _, case in ipairs(cases) do
+    local op_name, args = case[1], case[2]
+    local op_load = bitwise_op_load(op_name)
+    local op_cached = test_lib.bitwise_op(op_name)
+    assert(op_load(unpack(args)) == op_cached(unpack(args)))
+
+    local load_ops = ops_per_sec(op_load, args)
+    local cached_ops = ops_per_sec(op_cached, args)
+    print(("op: %2s, args: %d, load(): %10.0f ops/s, " ..
+           "cached: %10.0f ops/s, speedup: %.1f"):format(
+          op_name, #args, load_ops, cached_ops, cached_ops / load_ops))
+end
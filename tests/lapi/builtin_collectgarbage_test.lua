@@ -57,4 +57,4 @@ end
 local args = {
     artifact_prefix = "builtin_collectgarbage_",
 }
-luzer.Fuzz(TestOneInput, nil, args)
+luzer.Fuzz(test_lib.memory_oracle(TestOneInput), nil, args)
@@ -0,0 +1,82 @@
+--[[
+SPDX-License-Identifier: ISC
+Copyright (c) 2023-2025, Sergey Bronnikov.
+
+Micro-benchmark for coroutines, it creates 10^4, 10^5, ...
+suspended coroutines with different stack depths and reports:
+
+- memory per coroutine in bytes;
+- a latency of a pair `coroutine.resume()` and
+  `coroutine.yield()` in nanoseconds;
+- a time of a full garbage collection per suspended coroutine in
+  nanoseconds, it is a time of traversal of a coroutine stack.
+
+The maximum number of coroutines is set by an environment
+variable `BENCH_MAX_COROUTINES`.
+]]
+
+local MAX_COROUTINES = tonumber(os.getenv("BENCH_MAX_COROUTINES")) or 100000
+local DEPTHS = { 0, 16, 64 }
+local NUM_YIELDS = 4
+
+-- The function calls itself `depth` times and yields on the top
+-- of the stack, recursive calls are not tail calls.
+local function coro_body(depth)
+    if depth > 0 then
+        local res = coro_body(depth - 1)
+        return res
+    end
+    while true do
+        coroutine.yield()
+    end
+end
+
+local function gc_full()
+    collectgarbage("collect")
+    collectgarbage("collect")
+    return collectgarbage("count") * 1024
+end
+
+local function bench(num_coros, depth)
+    local coros = {}
+    local mem_start = gc_full()
+    for i = 1, num_coros do
+        local co = coroutine.create(coro_body)
+        coroutine.resume(co, depth)
+        coros[i] = co
+    end
+    local mem_per_coro = (gc_full() - mem_start) / num_coros
+
+    local resume = coroutine.resume
+    local start = os.clock()
+    for _ = 1, NUM_YIELDS do
+        for i = 1, num_coros do
+            resume(coros[i])
+        end
+    end
+    local ns_per_resume = (os.clock() - start) * 1e9 /
+                          (num_coros * NUM_YIELDS)
+
+    start = os.clock()
+    collectgarbage("collect")
+    local gc_time = os.clock() - start
+    coros = nil -- luacheck: no unused
+    -- A full garbage collection without coroutines is a baseline.
+    gc_full()
+    start = os.clock()
+    collectgarbage("collect")
+    local gc_base = os.clock() - start
+    local ns_gc_per_coro = math.max(gc_time - gc_base, 0) * 1e9 / num_coros
+
+    print(("coroutines: %7d, depth: %2d, bytes/coroutine: %7.1f, " ..
+           "ns/resume: %7.1f, GC ns/coroutine: %7.1f"):format(num_coros,
+           depth, mem_per_coro, ns_per_resume, ns_gc_per_coro))
+end
+
+local num_coros = 10000
+while num_coros <= MAX_COROUTINES do
+    for _, depth in ipairs(DEPTHS) do
+        bench(num_coros, depth)
+    end
+    num_coros = num_coros * 10
+end
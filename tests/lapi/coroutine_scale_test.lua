@@ -0,0 +1,104 @@
+--[[
+SPDX-License-Identifier: ISC
+Copyright (c) 2023-2025, Sergey Bronnikov.
+
+6.2 – Coroutine Manipulation,
+https://www.lua.org/manual/5.4/manual.html#6.2
+
+The test creates thousands of live coroutines with fuzzed stack
+depths and fuzzed yield patterns and resumes them in rounds in a
+fuzzed order, a full garbage collection is triggered between
+rounds, so the garbage collector traverses stacks of suspended
+coroutines.
+
+The maximum number of coroutines is set by an environment
+variable `LAPI_MAX_COROUTINES`.
+
+Synopsis:
+
+coroutine.create(f)
+coroutine.resume(co [, val1, ...])
+coroutine.status(co)
+coroutine.yield(...)
+]]
+
+local luzer = require("luzer")
+local test_lib = require("lib")
+
+local MAX_COROUTINES = tonumber(os.getenv("LAPI_MAX_COROUTINES")) or 10000
+local MAX_DEPTH = 64
+local MAX_YIELDS = 16
+
+-- The function calls itself `depth` times and yields
+-- `num_yields` times on the top of the stack. Recursive calls are
+-- not tail calls, so stack frames are alive while a coroutine is
+-- suspended.
+local function coro_body(depth, num_yields)
+    if depth > 0 then
+        local res = coro_body(depth - 1, num_yields)
+        return res
+    end
+    for i = 1, num_yields do
+        local val = coroutine.yield(i)
+        assert(val == i)
+    end
+    return num_yields
+end
+
+local function TestOneInput(buf, _size)
+    local fdp = luzer.FuzzedDataProvider(buf)
+    local num_coros = fdp:consume_integer(1, MAX_COROUTINES)
+    local coros = {}
+    for i = 1, num_coros do
+        coros[i] = {
+            co = coroutine.create(coro_body),
+            depth = fdp:consume_integer(0, MAX_DEPTH),
+            num_yields = fdp:consume_integer(0, MAX_YIELDS),
+            num_resumes = 0,
+        }
+    end
+
+    local num_alive = num_coros
+    while num_alive > 0 do
+        for i = 1, num_coros do
+            local c = coros[i]
+            -- A coroutine is skipped in a round to vary an order
+            -- of resumes, an exhausted data provider returns
+            -- false, so the loop is finite.
+            if c.co and not fdp:consume_boolean() then
+                local ok, res
+                if c.num_resumes == 0 then
+                    ok, res = coroutine.resume(c.co, c.depth, c.num_yields)
+                else
+                    ok, res = coroutine.resume(c.co, c.num_resumes)
+                end
+                assert(ok, res)
+                if coroutine.status(c.co) == "suspended" then
+                    c.num_resumes = c.num_resumes + 1
+                    assert(res == c.num_resumes)
+                else
+                    assert(coroutine.status(c.co) == "dead")
+                    assert(c.num_resumes == c.num_yields)
+                    assert(res == c.num_yields)
+                    c.co = nil
+                    num_alive = num_alive - 1
+                end
+            end
+        end
+        if fdp:consume_boolean() then
+            collectgarbage("collect")
+        end
+    end
+end
+
+-- A suspended coroutine with a deep stack takes kilobytes, an
+-- input takes a few bytes per coroutine. Memory retained by dead
+-- coroutines must be released.
+local memory_opts = {
+    peak_ratio = 64 * 1024,
+}
+
+local args = {
+    artifact_prefix = "coroutine_scale_",
+}
+luzer.Fuzz(test_lib.memory_oracle(TestOneInput, memory_opts), nil, args)
@@ -0,0 +1,143 @@
+--[[
+SPDX-License-Identifier: ISC
+Copyright (c) 2023-2025, Sergey Bronnikov.
+
+Micro-benchmark for debug hooks, it executes a generated workload
+with hooks installed by `debug.sethook()` with different masks
+and counts and reports a slowdown relative to a workload without
+hooks. In LuaJIT hooks disable the JIT compiler, so a slowdown
+relative to the interpreter (`jit.off()`) is reported as well.
+
+A minimal time in seconds to measure a mode is set by an
+environment variable `BENCH_MIN_TIME`.
+
+Slowdowns are compared with a baseline file set by an environment
+variable `BENCH_BASELINE`, the benchmark fails, when a slowdown
+is larger than a slowdown in the baseline by `BENCH_TOLERANCE`
+(0.25 by default). With an environment variable
+`BENCH_BASELINE_UPDATE` the baseline file is overwritten by
+current results. Every line of the file contains a mode name and
+a slowdown separated by a tab.
+]]
+
+local test_lib = require("lib")
+
+local MIN_TIME = tonumber(os.getenv("BENCH_MIN_TIME")) or 0.5
+local BASELINE = os.getenv("BENCH_BASELINE")
+local BASELINE_UPDATE = os.getenv("BENCH_BASELINE_UPDATE") ~= nil
+local TOLERANCE = tonumber(os.getenv("BENCH_TOLERANCE")) or 0.25
+
+local is_luajit = test_lib.lua_version() == "LuaJIT"
+
+local modes = {
+    { name = "call", mask = "c" },
+    { name = "return", mask = "r" },
+    { name = "line", mask = "l" },
+    { name = "call+return", mask = "cr" },
+    { name = "call+return+line", mask = "crl" },
+    { name = "count 1", mask = "", count = 1 },
+    { name = "count 100", mask = "", count = 100 },
+    { name = "count 1000", mask = "", count = 1000 },
+    { name = "count 10000", mask = "", count = 10000 },
+}
+
+-- A seed is fixed, so a workload is the same in every run.
+local workload = test_lib.random_workload(test_lib.random_source(42),
+                                          64, 1000)
+
+local function hook() end
+
+-- Returns a time of a single execution of a workload by
+-- a coroutine `co` in seconds.
+local function run_time(co)
+    local num_runs = 0
+    local start = os.clock()
+    local elapsed
+    repeat
+        assert(coroutine.resume(co))
+        num_runs = num_runs + 1
+        elapsed = os.clock() - start
+    until elapsed >= MIN_TIME
+    return elapsed / num_runs
+end
+
+-- The hook is installed in a coroutine, that executes
+-- a workload in a loop.
+local function mode_time(mode)
+    local co = coroutine.create(function()
+        while true do
+            workload()
+            coroutine.yield()
+        end
+    end)
+    if mode then
+        debug.sethook(co, hook, mode.mask, mode.count)
+    end
+    local time = run_time(co)
+    debug.sethook(co)
+    return time
+end
+
+local function read_baseline(path)
+    local baseline = {}
+    local f = path and io.open(path, "r")
+    if not f then
+        return baseline
+    end
+    for line in f:lines() do
+        local name, slowdown = line:match("^(.-)\t(%S+)$")
+        if name then
+            baseline[name] = tonumber(slowdown)
+        end
+    end
+    f:close()
+    return baseline
+end
+
+local function write_baseline(path, results)
+    local f = assert(io.open(path, "w"))
+    for _, res in ipairs(results) do
+        f:write(("%s\t%.3f\n"):format(res.name, res.slowdown))
+    end
+    f:close()
+end
+
+local baseline = read_baseline(BASELINE)
+local base_time = mode_time()
+local interp_time
+if is_luajit then
+    local jit = require("jit")
+    jit.off()
+    interp_time = mode_time()
+    jit.on()
+end
+print(("%-18s %10.1f us/run"):format("none", base_time * 1e6))
+
+local results = {}
+local num_regressions = 0
+for _, mode in ipairs(modes) do
+    local time = mode_time(mode)
+    local slowdown = time / base_time
+    local line = ("%-18s %10.1f us/run, slowdown: %7.2f"):format(mode.name,
+        time * 1e6, slowdown)
+    if interp_time then
+        line = line .. (", vs. interpreter: %5.2f"):format(time / interp_time)
+    end
+    local base_slowdown = baseline[mode.name]
+    if base_slowdown then
+        line = line .. (", baseline: %7.2f"):format(base_slowdown)
+        if slowdown > base_slowdown * (1 + TOLERANCE) then
+            line = line .. ", REGRESSION"
+            num_regressions = num_regressions + 1
+        end
+    end
+    print(line)
+    table.insert(results, { name = mode.name, slowdown = slowdown })
+end
+
+if BASELINE and BASELINE_UPDATE then
+    write_baseline(BASELINE, results)
+end
+if num_regressions > 0 and not BASELINE_UPDATE then
+    os.exit(1)
+end
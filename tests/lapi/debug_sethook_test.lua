@@ -0,0 +1,142 @@
+--[[
+SPDX-License-Identifier: ISC
+Copyright (c) 2023-2025, Sergey Bronnikov.
+
+6.10 – The Debug Library,
+https://www.lua.org/manual/5.4/manual.html#6.10
+
+The test installs hooks with fuzzed masks and counts in a main
+coroutine and in a number of coroutines, that execute a generated
+workload. A hook must not change results of the workload, and
+`debug.gethook()` must return the hook, the mask and the count
+set by `debug.sethook()`. In LuaJIT hooks are global for all
+coroutines, hooks disable the JIT compiler.
+
+Synopsis:
+
+debug.sethook([thread,] hook, mask [, count])
+debug.gethook([thread])
+]]
+
+local luzer = require("luzer")
+
+local test_lib = require("lib")
+
+local MAX_COROUTINES = 8
+local MAX_COUNT = 1000
+local MAX_OPS = 16
+local MAX_SIZE = 100
+
+local unpack = unpack or table.unpack
+
+local hook_mask = {
+    "c", -- The hook is called every time Lua calls a function.
+    "r", -- The hook is called every time Lua returns from a
+         -- function.
+    "l", -- The hook is called every time Lua enters a new line of
+         -- code.
+}
+
+local events = {}
+
+local function hook(event)
+    events[event] = (events[event] or 0) + 1
+end
+
+-- Returns a mask string in the order returned by
+-- `debug.gethook()`.
+local function random_mask(fdp)
+    local mask = {}
+    for _, m in ipairs(hook_mask) do
+        if fdp:consume_boolean() then
+            table.insert(mask, m)
+        end
+    end
+    return table.concat(mask)
+end
+
+local function sethook(fdp, co)
+    local mask = random_mask(fdp)
+    local count = fdp:consume_integer(0, MAX_COUNT)
+    local args = { hook, mask, count }
+    if co then
+        table.insert(args, 1, co)
+    end
+    debug.sethook(unpack(args))
+
+    local h, m, c
+    if co then
+        h, m, c = debug.gethook(co)
+    else
+        h, m, c = debug.gethook()
+    end
+    -- The hook is turned off. Lua 5.1 and LuaJIT keep a hook
+    -- function in a hook table and `debug.gethook()` returns it
+    -- with an empty mask.
+    if mask == "" and count == 0 and
+       test_lib.lua_current_version_ge_than(5, 2) then
+        assert(h == nil)
+    else
+        assert(h == hook)
+        assert(m == mask)
+        assert(c == count)
+    end
+    return mask
+end
+
+-- Events reported for every letter of a hook mask.
+local mask_events = {
+    c = "call",
+    r = "return",
+    l = "line",
+}
+
+local function TestOneInput(buf, _size)
+    local fdp = luzer.FuzzedDataProvider(buf)
+    local workload = test_lib.random_workload(fdp, MAX_OPS, MAX_SIZE)
+    local expected = workload()
+
+    local coros = {}
+    for i = 1, fdp:consume_integer(0, MAX_COROUTINES) do
+        coros[i] = coroutine.create(workload)
+        sethook(fdp, coros[i])
+    end
+    local mask = sethook(fdp)
+
+    events = {}
+    assert(workload() == expected)
+    -- Every operation is a function call with a loop or a call
+    -- inside. LuaJIT can run compiled traces without hooks.
+    if test_lib.lua_version() ~= "LuaJIT" then
+        for m in mask:gmatch(".") do
+            assert(events[mask_events[m]] > 0)
+        end
+    end
+    local num_alive = #coros
+    while num_alive > 0 do
+        num_alive = 0
+        for _, co in ipairs(coros) do
+            if coroutine.status(co) == "suspended" then
+                local ok, res = coroutine.resume(co, coroutine.yield)
+                assert(ok, res)
+                if coroutine.status(co) == "dead" then
+                    assert(res == expected)
+                else
+                    num_alive = num_alive + 1
+                end
+            end
+        end
+    end
+
+    -- Turn off hooks.
+    debug.sethook()
+    for _, co in ipairs(coros) do
+        debug.sethook(co)
+    end
+    events = {}
+end
+
+local args = {
+    artifact_prefix = "debug_sethook_",
+}
+luzer.Fuzz(TestOneInput, nil, args)
@@ -26,6 +26,56 @@ local MAX_N = 1e3
 
 local unpack = unpack or table.unpack
 
+-- With an environment variable `LAPI_IO_MEMFILE` a file is backed
+-- by memory instead of a file created by `io.tmpfile()` on disk
+-- for every input. With LuaJIT a memory file is created by
+-- `memfd_create()` once, and it is reopened with truncation by
+-- a path in /proc for every input. Otherwise, a file is created
+-- in tmpfs (/dev/shm). In both cases a file is opened by
+-- `io.open()`, so the same `FILE *` code paths in liolib.c are
+-- executed.
+local IO_MEMFILE = os.getenv("LAPI_IO_MEMFILE") ~= nil
+
+local function memfd_path()
+    if test_lib.lua_version() ~= "LuaJIT" then
+        return nil
+    end
+    local ffi = require("ffi")
+    ffi.cdef("int memfd_create(const char *name, unsigned int flags);")
+    -- The function is missed in glibc before 2.27.
+    local ok, fd = pcall(function()
+        return ffi.C.memfd_create("io_torture", 0)
+    end)
+    if not ok or fd < 0 then
+        return nil
+    end
+    return ("/proc/self/fd/%d"):format(fd)
+end
+
+local function shm_path()
+    local tmpname = os.tmpname()
+    os.remove(tmpname)
+    local path = "/dev/shm/" .. tmpname:match("[^/]+$")
+    local fh = io.open(path, "w+b")
+    if not fh then
+        return nil
+    end
+    fh:close()
+    os.remove(path)
+    return path
+end
+
+local memfile_path
+-- A file in tmpfs is removed after every input.
+local memfile_is_tmp = false
+if IO_MEMFILE then
+    memfile_path = memfd_path()
+    if not memfile_path then
+        memfile_path = shm_path()
+        memfile_is_tmp = true
+    end
+end
+
 local function io_seek(self)
     local SEEK_MODE = {
         "set", -- Base is position 0 (beginning of the file).
@@ -97,6 +147,9 @@ end
 
 local function io_close(self)
     self.fh:close()
+    if memfile_path and memfile_is_tmp then
+        os.remove(memfile_path)
+    end
 end
 
 local io_methods = {
@@ -113,7 +166,12 @@ local function io_random_op(self)
 end
 
 local function io_new(fdp)
-    local fh = io.tmpfile()
+    local fh
+    if memfile_path then
+        fh = assert(io.open(memfile_path, "w+b"))
+    else
+        fh = io.tmpfile()
+    end
     return {
         close = io_close,
         fdp = fdp,
@@ -57,23 +57,51 @@ local MIN_INT = -0x80000000
 
 local MAX_STR_LEN = 4096
 
+-- Compiled bitwise operations, a key is an operator name and
+-- a number of operands, a value is a function.
+local bitwise_op_cache = {}
+
+-- The function compiles a unary or binary bitwise operation
+-- once, operands are passed as parameters.
+local function bitwise_op_func(op_name, arity)
+    local key = op_name .. arity
+    local func = bitwise_op_cache[key]
+    if func then
+        return func
+    end
+    local chunk
+    if arity == 1 then
+        chunk = ("return function(x) return %s x end"):format(op_name)
+    else
+        chunk = ("return function(x, y) return x %s y end"):format(op_name)
+    end
+    func = assert(load(chunk))()
+    bitwise_op_cache[key] = func
+    return func
+end
+
 local function bitwise_op(op_name)
     return function(...)
         local n = select("#", ...)
-        local chunk
         -- Bitwise exclusive OR and bitwise NOT have the same
         -- operator.
         if (op_name == "&" or op_name == "|") then
             assert(n > 1)
         end
         if n == 1 then
-            local x = ...
-            chunk = ("return %s %d"):format(op_name, x)
-        else
-            local op_name_ws = (" %s "):format(op_name)
-            chunk = "return " .. table.concat({...}, op_name_ws)
+            return bitwise_op_func(op_name, 1)(...)
         end
-        return assert(load(chunk))()
+        -- Bitwise operators are left associative, so
+        -- `x1 op x2 op x3` is `(x1 op x2) op x3`.
+        local op = bitwise_op_func(op_name, 2)
+        local res = op(...)
+        if n > 2 then
+            local args = {...}
+            for i = 3, n do
+                res = op(res, args[i])
+            end
+        end
+        return res
     end
 end
 
@@ -86,19 +114,107 @@ local function approx_equal(a, b, epsilon)
     return abs(a - b) <= ((abs(a) < abs(b) and abs(b) or abs(a)) * epsilon)
 end
 
+-- Locales available in a system, see `available_locales()`.
 local locales
+-- Locale data cached by `locales_prewarm()`, a key is a locale
+-- name.
+local locale_info = {}
+local locales_are_prewarmed = false
+-- A locale pinned for a process, see `random_locale()`.
+local pinned_locale
+-- A locale set by `setlocale()`.
+local current_locale
 
-local function random_locale(fdp)
+local LOCALE_PREWARM = os.getenv("LAPI_LOCALE_PREWARM") ~= nil
+local LOCALE_PIN = os.getenv("LAPI_LOCALE")
+
+local function available_locales()
     if locales then
-        return fdp:oneof(locales)
+        return locales
     end
     local locale_it = io.popen("locale -a"):read("*a"):gmatch("([^\n]*)\n?")
     locales = {}
     for locale in locale_it do
         table.insert(locales, locale)
     end
+    return locales
+end
+
+-- The function switches to every available locale once, a first
+-- switch to a locale loads locale data in glibc and next switches
+-- are cheaper. Locales that cannot be set are excluded, a decimal
+-- point (see localeconv(3)) used by `string.format()` in every
+-- locale is cached.
+local function locales_prewarm()
+    if locales_are_prewarmed then
+        return locales
+    end
+    local saved_locale = os.setlocale(nil, "all")
+    local valid_locales = {}
+    for _, locale in ipairs(available_locales()) do
+        if os.setlocale(locale, "all") then
+            table.insert(valid_locales, locale)
+            locale_info[locale] = {
+                decimal_point = ("%.1f"):format(0.5):sub(2, 2),
+            }
+        end
+    end
+    os.setlocale(saved_locale, "all")
+    current_locale = nil
+    locales = valid_locales
+    locales_are_prewarmed = true
+    return locales
+end
 
-    return fdp:oneof(locales)
+local function locale_decimal_point(locale)
+    local info = locale_info[locale]
+    return info and info.decimal_point
+end
+
+-- Returns a locale chosen once per process, so parallel workers
+-- use different locales. `math.random()` is not used, it is
+-- deterministic in Lua 5.1 and LuaJIT and tests may set a seed.
+local function per_process_locale(all_locales)
+    local f = assert(io.open("/dev/urandom", "rb"))
+    local bytes = f:read(4)
+    f:close()
+    local n = 0
+    for i = 1, #bytes do
+        n = n * 256 + bytes:byte(i)
+    end
+    return all_locales[n % #all_locales + 1]
+end
+
+-- The function returns a random locale. With an environment
+-- variable `LAPI_LOCALE_PREWARM` locales are prewarmed on first
+-- use, see `locales_prewarm()`. With an environment variable
+-- `LAPI_LOCALE` the function always returns a locale set in the
+-- variable, or a locale chosen once per process when the value
+-- is "*". Data are consumed from `fdp` in all cases, so the same
+-- input is decoded in the same way.
+local function random_locale(fdp)
+    local all_locales = LOCALE_PREWARM and locales_prewarm() or
+                        available_locales()
+    local locale = fdp:oneof(all_locales)
+    if LOCALE_PIN then
+        if not pinned_locale then
+            pinned_locale = LOCALE_PIN == "*" and
+                            per_process_locale(all_locales) or LOCALE_PIN
+        end
+        return pinned_locale
+    end
+    return locale
+end
+
+-- The function sets a locale for all categories, the locale is
+-- not switched when it is already set by the function.
+local function setlocale(locale)
+    if locale == current_locale then
+        return locale
+    end
+    local res = os.setlocale(locale, "all")
+    current_locale = res and locale or nil
+    return res
 end
 
 local function err_handler(ignored_msgs)
@@ -124,21 +240,527 @@ local function arrays_equal(t1, t2)
     return #t1 == #t2
 end
 
+-- The function compares values recursively, tables are equal
+-- when they have equal keys and values, FFI cdata objects are
+-- equal when they have equal string representations, e.g.
+-- `1LL` and `1LL`.
+local function deep_equal(v1, v2)
+    if type(v1) ~= type(v2) then
+        return false
+    end
+    if type(v1) == "number" then
+        return v1 == v2 or (is_nan(v1) and is_nan(v2))
+    end
+    if type(v1) == "cdata" then
+        return tostring(v1) == tostring(v2)
+    end
+    if type(v1) ~= "table" then
+        return v1 == v2
+    end
+    for key, value in pairs(v1) do
+        if not deep_equal(value, v2[key]) then
+            return false
+        end
+    end
+    for key in pairs(v2) do
+        if v1[key] == nil then
+            return false
+        end
+    end
+    return true
+end
+
+-- Benchmark helpers, see bench.lua.
+
+-- A function under test, e.g. `select()`, is replaced by
+-- a wrapper, so the wrapper uses a function saved on load.
+local bench_select = select
+
+-- The function returns a wrapper for a function `func`, that
+-- saves arguments of every call to an array `calls`.
+local function bench_record(func, calls)
+    return function(...)
+        calls[#calls + 1] = { n = bench_select("#", ...), ... }
+        return func(...)
+    end
+end
+
+-- A function under test may change its arguments, for example
+-- `table.sort()`, so tables in arguments are copied before
+-- every execution.
+local function bench_copy_args(args)
+    local copy = { n = args.n }
+    for i = 1, args.n do
+        local v = args[i]
+        if type(v) == "table" then
+            local t = {}
+            for key, value in pairs(v) do
+                t[key] = value
+            end
+            debug.setmetatable(t, debug.getmetatable(v))
+            v = t
+        end
+        copy[i] = v
+    end
+    return copy
+end
+
+-- The function executes a function `func` with arguments saved
+-- by `bench_record()` `rounds` times and returns time in
+-- nanoseconds and memory in bytes allocated per call. Garbage
+-- collector is stopped during measurements.
+local function bench_calls(func, calls, rounds)
+    local unpack = unpack or table.unpack
+    local elapsed = 0
+    local allocated = 0
+    local num_calls = 0
+    for _ = 1, rounds do
+        local args = {}
+        for i, call in ipairs(calls) do
+            args[i] = bench_copy_args(call)
+        end
+        collectgarbage("collect")
+        collectgarbage("stop")
+        local mem_start = collectgarbage("count")
+        local start = os.clock()
+        for i = 1, #args do
+            pcall(func, unpack(args[i], 1, args[i].n))
+        end
+        elapsed = elapsed + (os.clock() - start)
+        allocated = allocated + (collectgarbage("count") - mem_start) * 1024
+        collectgarbage("restart")
+        num_calls = num_calls + #args
+    end
+    if num_calls == 0 then
+        return 0, 0
+    end
+    return elapsed * 1e9 / num_calls, allocated / num_calls
+end
+
+-- Algorithmic complexity oracle, see `complexity_oracle()`.
+
+local COMPLEXITY_ORACLE = os.getenv("LAPI_COMPLEXITY_ORACLE") ~= nil
+
+-- Documented complexity functions, an argument is an input size.
+local complexity_funcs = {
+    ["O(n)"] = function(n) return n end,
+    ["O(n log n)"] = function(n) return n * math.log(n) end,
+    ["O(n^2)"] = function(n) return n * n end,
+}
+
+-- A count hook is called every `HOOK_COUNT` VM instructions.
+local HOOK_COUNT = 100
+-- A minimal CPU time in seconds to measure a function call.
+local MIN_CPU_TIME = 1e-3
+-- A number of normalized costs used to compute a baseline.
+local COMPLEXITY_WINDOW = 101
+
+local function pack(...)
+    return { n = select("#", ...), ... }
+end
+
+-- Returns a number of VM instructions executed by a function
+-- `func` and results of the function.
+local function cost_instructions(func, ...)
+    local unpack = unpack or table.unpack
+    local count = 0
+    local hook, mask, hook_count = debug.gethook()
+    debug.sethook(function()
+        count = count + HOOK_COUNT
+    end, "", HOOK_COUNT)
+    local res = pack(pcall(func, ...))
+    if type(hook) == "function" then
+        debug.sethook(hook, mask, hook_count)
+    else
+        debug.sethook()
+    end
+    if not res[1] then
+        error(res[2], 0)
+    end
+    return count, unpack(res, 2, res.n)
+end
+
+-- Returns CPU time per call of a function `func` and results
+-- of the function. The function is called repeatedly, so it
+-- must have no side effects.
+local function cost_cpu_time(func, ...)
+    local unpack = unpack or table.unpack
+    local res = pack(func(...))
+    local num_calls = 0
+    local elapsed
+    local start = os.clock()
+    repeat
+        func(...)
+        num_calls = num_calls + 1
+        elapsed = os.clock() - start
+    until elapsed >= MIN_CPU_TIME
+    return elapsed / num_calls, unpack(res, 1, res.n)
+end
+
+local function complexity_oracle_is_enabled()
+    return COMPLEXITY_ORACLE
+end
+
+-- The function returns a wrapper `oracle(n, func, ...)`, that
+-- calls `func(...)` and returns its results. With an environment
+-- variable `LAPI_COMPLEXITY_ORACLE` the wrapper measures a cost
+-- of the call and divides it by a documented complexity
+-- `complexity` of an input size `n`. An error is raised when the
+-- normalized cost is `factor` times higher than a median of
+-- normalized costs of previous inputs, that is, the cost grows
+-- faster than the documented complexity. A median is not
+-- affected by inputs, that exit early, e.g. `string.find()` with
+-- `init` greater than a string length, or by a constant cost of
+-- a call. CPU time, that exceeds the limit, is measured again, and
+-- the smallest cost is checked, so a single noisy measurement
+-- does not raise an error. A number of VM instructions is not
+-- measured again: it does not vary between calls, and a function
+-- may change its arguments, e.g. `table.sort()`.
+--
+-- Options:
+-- `metric` is "instructions" or "cpu_time" (default). VM
+-- instructions are executed only in Lua functions, for example,
+-- in a comparator passed to `table.sort()`, so CPU time is used
+-- for functions that do not call Lua code.
+-- `factor` is an allowed ratio of normalized costs, 10 by default.
+-- `min_size` is a minimal checked input size, 64 by default,
+-- for smaller sizes a constant cost of a call dominates.
+-- `warmup` is a number of inputs measured before the first check,
+-- 32 by default.
+local function complexity_oracle(name, complexity, opts)
+    opts = opts or {}
+    local complexity_func = assert(complexity_funcs[complexity],
+        "unknown complexity")
+    local cost_func = opts.metric == "instructions" and
+                      cost_instructions or cost_cpu_time
+    local factor = opts.factor or 10
+    local min_size = opts.min_size or 64
+    local warmup = opts.warmup or 32
+    -- Normalized costs of the last `COMPLEXITY_WINDOW` inputs.
+    local ratios = {}
+    local next_ratio = 1
+
+    -- Hooks are not called in a JIT-compiled code.
+    if COMPLEXITY_ORACLE and opts.metric == "instructions" and
+       rawget(_G, "jit") then
+        jit.off()
+    end
+
+    local function median()
+        local sorted = {}
+        for i, ratio in ipairs(ratios) do
+            sorted[i] = ratio
+        end
+        table.sort(sorted)
+        return sorted[math.ceil(#sorted / 2)]
+    end
+
+    return function(n, func, ...)
+        if not COMPLEXITY_ORACLE or n < min_size then
+            return func(...)
+        end
+        local unpack = unpack or table.unpack
+        local res = pack(cost_func(func, ...))
+        local ratio = res[1] / complexity_func(n)
+        if #ratios >= warmup then
+            local baseline = median()
+            if ratio > baseline * factor and
+               cost_func == cost_cpu_time then
+                local cost = cost_func(func, ...)
+                ratio = math.min(ratio, cost / complexity_func(n))
+            end
+            if ratio > baseline * factor then
+                error(("%s: cost %g for input size %d is %.1f times " ..
+                       "higher than expected for %s"):format(name,
+                       ratio * complexity_func(n), n, ratio / baseline,
+                       complexity))
+            end
+        end
+        if ratio > 0 then
+            ratios[next_ratio] = ratio
+            next_ratio = next_ratio % COMPLEXITY_WINDOW + 1
+        end
+        return unpack(res, 2, res.n)
+    end
+end
+
+-- Memory oracle, see `memory_oracle()`.
+
+local MEMORY_ORACLE = os.getenv("LAPI_MEMORY_ORACLE") ~= nil
+
+-- Returns a number of bytes in use after a full garbage
+-- collection.
+local function gc_full()
+    -- Objects with finalizers are released in the next cycle.
+    collectgarbage("collect")
+    collectgarbage("collect")
+    return collectgarbage("count") * 1024
+end
+
+-- The function returns a wrapper for a test function
+-- `test_one_input`. With an environment variable
+-- `LAPI_MEMORY_ORACLE` the wrapper forces a full garbage
+-- collection before and after every input and raises an error,
+-- when:
+--
+-- - memory allocated by a test is `peak_ratio` times larger than
+--   an input size and larger than `min_peak` bytes. Garbage
+--   collector is stopped during the test, so allocated memory is
+--   an upper bound of a memory peak;
+-- - memory retained after a full garbage collection grows more
+--   than `max_growth` bytes since the first `warmup` inputs,
+--   that populate caches in test helpers and in the runtime.
+local function memory_oracle(test_one_input, opts)
+    if not MEMORY_ORACLE then
+        return test_one_input
+    end
+    opts = opts or {}
+    local peak_ratio = opts.peak_ratio or 1024
+    local min_peak = opts.min_peak or 1024 * 1024
+    local max_growth = opts.max_growth or 16 * 1024 * 1024
+    local warmup = opts.warmup or 100
+    local unpack = unpack or table.unpack
+    local num_inputs = 0
+    local baseline
+
+    return function(buf, ...)
+        local mem_start = gc_full()
+        collectgarbage("stop")
+        local res = pack(pcall(test_one_input, buf, ...))
+        local peak = collectgarbage("count") * 1024 - mem_start
+        collectgarbage("restart")
+        local retained = gc_full()
+        if not res[1] then
+            error(res[2], 0)
+        end
+
+        num_inputs = num_inputs + 1
+        if peak > min_peak and peak > peak_ratio * #buf then
+            error(("memory peak %d bytes is %.0f times larger than " ..
+                   "an input size %d bytes"):format(peak, peak / #buf, #buf))
+        end
+        if num_inputs == warmup then
+            baseline = retained
+        end
+        if baseline and retained - baseline > max_growth then
+            error(("retained memory grows by %d bytes in %d inputs"):format(
+                  retained - baseline, num_inputs - warmup))
+        end
+        return unpack(res, 2, res.n)
+    end
+end
+
+-- Leaf generators for `random_object()`, `src` is
+-- a FuzzedDataProvider or an object with the same methods.
+local leaf_generators = {
+    boolean = function(src)
+        return src:consume_boolean()
+    end,
+    cdata = function(src)
+        local ffi = require("ffi")
+        local ctype = src:consume_boolean() and "int64_t" or "uint64_t"
+        return ffi.new(ctype, src:consume_integer(MIN_INT, MAX_INT))
+    end,
+    integer = function(src)
+        return src:consume_integer(MIN_INT, MAX_INT)
+    end,
+    number = function(src)
+        return src:consume_number(MIN_INT64, MAX_INT64)
+    end,
+    string = function(src, shape)
+        return src:consume_string(shape.max_str_len or MAX_STR_LEN)
+    end,
+}
+
+-- The function generates a nested table with a given shape:
+--
+-- `depth` is a maximum depth of nested tables;
+-- `width` is a maximum number of items in a table;
+-- `min_width` is a minimum number of items in a table, 0 by
+-- default;
+-- `leaves` is an array with types of leaf values: "boolean",
+-- "cdata" (LuaJIT only), "integer", "number" and "string";
+-- `max_str_len` is a maximum length of a string leaf and
+-- a string key;
+-- `keys` is "array", when items are stored in an array part only,
+-- otherwise items are stored in an array part or with string keys.
+--
+-- Values are generated from a source `src`, that is
+-- a FuzzedDataProvider or an object with the same methods.
+local function random_object(src, shape, depth)
+    depth = depth or shape.depth
+    if depth == 0 then
+        local leaf_type = shape.leaves[src:consume_integer(1, #shape.leaves)]
+        return leaf_generators[leaf_type](src, shape)
+    end
+    local t = {}
+    local n = src:consume_integer(shape.min_width or 0, shape.width)
+    for i = 1, n do
+        local value = random_object(src, shape, depth - 1)
+        if shape.keys == "array" or src:consume_boolean() then
+            t[i] = value
+        else
+            t[src:consume_string(shape.max_str_len or MAX_STR_LEN)] = value
+        end
+    end
+    return t
+end
+
+-- Operations of a workload generated by `random_workload()`,
+-- every operation takes a size `n` and returns a number.
+local workload_ops = {
+    -- Arithmetic in a loop.
+    function(n)
+        local sum = 0
+        for i = 1, n do
+            sum = (sum + i * i) % 65521
+        end
+        return sum
+    end,
+    -- A chain of nested calls, calls are not tail calls.
+    function(n)
+        local function f(depth)
+            if depth == 0 then
+                return 0
+            end
+            local res = f(depth - 1)
+            return res + 1
+        end
+        return f(n)
+    end,
+    -- Strings.
+    function(n)
+        local parts = {}
+        for i = 1, n do
+            parts[i] = tostring(i)
+        end
+        return #table.concat(parts, ",")
+    end,
+    -- Tables.
+    function(n)
+        local t = {}
+        for i = 1, n do
+            t[#t + 1] = i
+        end
+        local sum = 0
+        for _, v in ipairs(t) do
+            sum = sum + v
+        end
+        return sum
+    end,
+    -- Errors.
+    function(n)
+        local num_errors = 0
+        for i = 1, n do
+            if not pcall(error, i) then
+                num_errors = num_errors + 1
+            end
+        end
+        return num_errors
+    end,
+}
+
+-- The function generates a workload, that is a sequence of at
+-- most `max_ops` operations with a size up to `max_size`. It
+-- returns a function `workload(yield)`, that executes the
+-- sequence, calls `yield()` between operations, when it is
+-- passed, and returns a checksum of results. Operations are
+-- chosen by a source `src`, that is a FuzzedDataProvider or an
+-- object with the same methods.
+local function random_workload(src, max_ops, max_size)
+    local ops = {}
+    local sizes = {}
+    for i = 1, src:consume_integer(1, max_ops) do
+        ops[i] = workload_ops[src:consume_integer(1, #workload_ops)]
+        sizes[i] = src:consume_integer(1, max_size)
+    end
+    return function(yield)
+        local checksum = 0
+        for i = 1, #ops do
+            checksum = (checksum + ops[i](sizes[i])) % 65521
+            if yield then
+                yield()
+            end
+        end
+        return checksum
+    end
+end
+
+-- The function returns a source of pseudo-random values with
+-- methods of FuzzedDataProvider, values depend on a seed only,
+-- so benchmarks are reproducible.
+local function random_source(seed)
+    math.randomseed(seed)
+    return {
+        consume_boolean = function()
+            return math.random(2) == 1
+        end,
+        consume_integer = function(_, min, max)
+            return math.floor(min + (max - min) * math.random() + 0.5)
+        end,
+        consume_number = function(_, min, max)
+            return min + (max - min) * math.random()
+        end,
+        consume_string = function(_, max_len)
+            local bytes = {}
+            for i = 1, math.random(0, max_len) do
+                bytes[i] = string.char(math.random(0, 255))
+            end
+            return table.concat(bytes)
+        end,
+    }
+end
+
+-- The function returns an object, that counts moves of data of
+-- a LuaJIT string buffer `buf`: reallocations on growth and
+-- compactions of consumed space. A method `call(method, ...)`
+-- calls a buffer method and counts a move, when an address
+-- returned by `buf:ref()` is changed by the method.
+local function buffer_tracker(buf)
+    return {
+        moves = 0,
+        bytes_moved = 0,
+        call = function(self, method, ...)
+            local ptr, len = buf:ref()
+            local res = pack(method(buf, ...))
+            if buf:ref() ~= ptr and len > 0 then
+                self.moves = self.moves + 1
+                self.bytes_moved = self.bytes_moved + len
+            end
+            return (unpack or table.unpack)(res, 1, res.n)
+        end,
+    }
+end
+
 return {
     approx_equal = approx_equal,
     arrays_equal = arrays_equal,
+    bench_calls = bench_calls,
+    bench_record = bench_record,
     bitwise_op = bitwise_op,
+    buffer_tracker = buffer_tracker,
+    complexity_oracle = complexity_oracle,
+    complexity_oracle_is_enabled = complexity_oracle_is_enabled,
+    deep_equal = deep_equal,
     err_handler = err_handler,
     lua_current_version_ge_than = lua_current_version_ge_than,
     lua_current_version_lt_than = lua_current_version_lt_than,
     lua_version = lua_version,
     math_pow = math_pow,
+    memory_oracle = memory_oracle,
+    random_source = random_source,
     MAX_INT64 = MAX_INT64,
     MIN_INT64 = MIN_INT64,
     MAX_INT = MAX_INT,
     MIN_INT = MIN_INT,
     MAX_STR_LEN = MAX_STR_LEN,
 
+    locale_decimal_point = locale_decimal_point,
+    locales_prewarm = locales_prewarm,
+    setlocale = setlocale,
+
     -- FDP.
     random_locale = random_locale,
+    random_object = random_object,
+    random_workload = random_workload,
 }
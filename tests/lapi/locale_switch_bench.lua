@@ -0,0 +1,64 @@
+--[[
+SPDX-License-Identifier: ISC
+Copyright (c) 2023-2025, Sergey Bronnikov.
+
+Micro-benchmark, that separates a cost of a locale switching
+from a cost of formatting by `string.format()` in every locale.
+Locales are prewarmed by `locales_prewarm()` in lib.lua.
+
+The number of iterations is set by an environment variable
+`BENCH_ITERATIONS`, the maximum number of locales is set by an
+environment variable `BENCH_MAX_LOCALES`.
+]]
+
+local test_lib = require("lib")
+
+local ITERATIONS = tonumber(os.getenv("BENCH_ITERATIONS")) or 10000
+local MAX_LOCALES = tonumber(os.getenv("BENCH_MAX_LOCALES")) or 16
+
+local formats = {
+    { "%d", 123456 },
+    { "%.3f", 1234.5678 },
+    { "%g", 1e-7 },
+    { "%e", -98765.4321 },
+    { "%x", 0xbeef },
+    { "%s", "string" },
+    { "%q", "a\nb\0c" },
+}
+
+-- Returns time in nanoseconds per call of a function `func`.
+local function ns_per_op(func)
+    local start = os.clock()
+    for _ = 1, ITERATIONS do
+        func()
+    end
+    return (os.clock() - start) * 1e9 / ITERATIONS
+end
+
+local function format_all()
+    for _, f in ipairs(formats) do
+        string.format(f[1], f[2])
+    end
+end
+
+local locales = test_lib.locales_prewarm()
+local saved_locale = os.setlocale(nil, "all")
+for i = 1, math.min(#locales, MAX_LOCALES) do
+    local locale = locales[i]
+    local other_locale = locales[i % #locales + 1]
+
+    -- Every call switches a locale.
+    local n = 0
+    local switch_ns = ns_per_op(function()
+        n = n + 1
+        os.setlocale(n % 2 == 0 and locale or other_locale, "all")
+    end)
+
+    os.setlocale(locale, "all")
+    local format_ns = ns_per_op(format_all) / #formats
+
+    print(("locale: %-24s decimal point: '%s', setlocale: %8.0f ns/op, " ..
+           "string.format: %6.0f ns/op"):format(("'%s'"):format(locale),
+           test_lib.locale_decimal_point(locale), switch_ns, format_ns))
+end
+os.setlocale(saved_locale, "all")
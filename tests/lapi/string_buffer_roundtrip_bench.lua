@@ -0,0 +1,88 @@
+--[[
+SPDX-License-Identifier: ISC
+Copyright (c) 2023-2025, Sergey Bronnikov.
+
+Micro-benchmark for LuaJIT serializer, `buffer.encode()` and
+`buffer.decode()`, it reports throughput in MB/s and objects/s
+for objects of different shapes: deep and wide tables, arrays of
+strings, numbers and FFI cdata. Objects are generated by
+`random_object()` in lib.lua, a round trip is checked for every
+object.
+
+The minimal time in seconds to measure a shape is set by an
+environment variable `BENCH_MIN_TIME`.
+]]
+
+local test_lib = require("lib")
+
+-- LuaJIT only.
+if test_lib.lua_version() ~= "LuaJIT" then
+    print("Unsupported version.")
+    os.exit(0)
+end
+
+local string_buf = require("string.buffer")
+
+local MIN_TIME = tonumber(os.getenv("BENCH_MIN_TIME")) or 0.5
+local MB = 1024 * 1024
+
+-- A seed is fixed, so objects are the same in every run.
+local random_src = test_lib.random_source(42)
+
+local shapes = {
+    { name = "deep", depth = 90, width = 1, min_width = 1,
+      leaves = { "integer" } },
+    { name = "wide", depth = 1, width = 100000, min_width = 100000,
+      leaves = { "integer", "string" }, max_str_len = 16 },
+    { name = "balanced", depth = 4, width = 16, min_width = 16,
+      leaves = { "boolean", "integer", "number", "string" },
+      max_str_len = 16 },
+    { name = "strings", depth = 1, width = 1000, min_width = 1000,
+      leaves = { "string" }, max_str_len = 4096 },
+    { name = "numbers", depth = 1, width = 100000, min_width = 100000,
+      leaves = { "number" }, keys = "array" },
+    { name = "cdata", depth = 1, width = 100000, min_width = 100000,
+      leaves = { "cdata" }, keys = "array" },
+}
+
+-- Returns a number of tables and leaf values in an object.
+local function count_objects(obj)
+    if type(obj) ~= "table" then
+        return 1
+    end
+    local n = 1
+    for _, value in pairs(obj) do
+        n = n + count_objects(value)
+    end
+    return n
+end
+
+-- Returns a number of calls per second.
+local function calls_per_sec(func, arg)
+    local num_calls = 0
+    local start = os.clock()
+    local elapsed
+    repeat
+        func(arg)
+        num_calls = num_calls + 1
+        elapsed = os.clock() - start
+    until elapsed >= MIN_TIME
+    return num_calls / elapsed
+end
+
+for _, shape in ipairs(shapes) do
+    local obj = test_lib.random_object(random_src, shape)
+    local str = string_buf.encode(obj)
+    assert(test_lib.deep_equal(obj, string_buf.decode(str)))
+
+    local num_objects = count_objects(obj)
+    local size_mb = #str / MB
+    local encode_rate = calls_per_sec(string_buf.encode, obj)
+    local decode_rate = calls_per_sec(string_buf.decode, str)
+    print(("%-8s size: %9d, objects: %7d, " ..
+           "encode: %8.1f MB/s %11.0f objects/s, " ..
+           "decode: %8.1f MB/s %11.0f objects/s"):format(shape.name,
+           #str, num_objects,
+           encode_rate * size_mb, encode_rate * num_objects,
+           decode_rate * size_mb, decode_rate * num_objects))
+end
@@ -0,0 +1,86 @@
+--[[
+SPDX-License-Identifier: ISC
+Copyright (c) 2023-2025, Sergey Bronnikov.
+
+String Buffer Library,
+https://luajit.org/ext_buffer.html
+
+The test generates nested tables with strings, numbers, booleans
+and FFI cdata of a random shape and checks that a decoded object
+is equal to an encoded one: decode(encode(x)) == x.
+
+Synopsis:
+
+str = buffer.encode(obj)
+obj = buffer.decode(str)
+]]
+
+local luzer = require("luzer")
+local test_lib = require("lib")
+
+-- LuaJIT only.
+if test_lib.lua_version() ~= "LuaJIT" then
+    print("Unsupported version.")
+    os.exit(0)
+end
+
+local string_buf = require("string.buffer")
+
+-- The serializer raises an error "too deep to serialize" for
+-- tables nested deeper than 100 levels.
+local MAX_DEPTH = 90
+local MAX_WIDTH = 32
+
+local LEAF_TYPES = {
+    "boolean",
+    "cdata",
+    "integer",
+    "number",
+    "string",
+}
+
+local function random_leaves(fdp)
+    local leaves = {}
+    for _, leaf_type in ipairs(LEAF_TYPES) do
+        if fdp:consume_boolean() then
+            table.insert(leaves, leaf_type)
+        end
+    end
+    if #leaves == 0 then
+        table.insert(leaves, fdp:oneof(LEAF_TYPES))
+    end
+    return leaves
+end
+
+local function TestOneInput(buf, _size)
+    local fdp = luzer.FuzzedDataProvider(buf)
+    -- Deep tables are narrow, anyway, a number of items is
+    -- bounded by an input size: tables are empty when data is
+    -- exhausted.
+    local depth = fdp:consume_integer(0, MAX_DEPTH)
+    local shape = {
+        depth = depth,
+        width = depth > 4 and 2 or MAX_WIDTH,
+        leaves = random_leaves(fdp),
+        max_str_len = fdp:consume_integer(0, test_lib.MAX_STR_LEN),
+    }
+    local obj = test_lib.random_object(fdp, shape)
+
+    local str = string_buf.encode(obj)
+    assert(type(str) == "string")
+    local decoded = string_buf.decode(str)
+    assert(test_lib.deep_equal(obj, decoded))
+
+    -- Encoding and decoding by buffer methods.
+    local b = string_buf.new()
+    b:encode(obj)
+    assert(b:tostring() == str)
+    assert(test_lib.deep_equal(obj, b:decode()))
+    assert(#b == 0)
+    b:free()
+end
+
+local args = {
+    artifact_prefix = "string_buffer_roundtrip_",
+}
+luzer.Fuzz(TestOneInput, nil, args)
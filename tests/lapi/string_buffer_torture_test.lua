@@ -279,4 +279,4 @@ end
 local args = {
     artifact_prefix = "string_buffer_torture_",
 }
-luzer.Fuzz(TestOneInput, nil, args)
+luzer.Fuzz(test_lib.memory_oracle(TestOneInput), nil, args)
@@ -0,0 +1,138 @@
+--[[
+SPDX-License-Identifier: ISC
+Copyright (c) 2023-2025, Sergey Bronnikov.
+
+Micro-benchmark for LuaJIT string buffers, it reports throughput
+in MB/s of writing a large stream by `buf:put()`,
+`buf:putcdata()`, `buf:reserve()`/`buf:commit()`, reading it by
+`buf:ref()`/`buf:skip()` and `buf:get()`, and encoding and
+decoding a stream of objects, decoding is performed from FFI
+cdata set by `buf:set()`. For write methods a number of data
+moves (reallocations and compactions) and moved bytes are
+reported for a buffer with default and preallocated sizes.
+
+A stream size in megabytes is set by an environment variable
+`BENCH_SIZE_MB`, a chunk size in bytes is set by an environment
+variable `BENCH_CHUNK_SIZE`.
+]]
+
+local test_lib = require("lib")
+
+-- LuaJIT only.
+if test_lib.lua_version() ~= "LuaJIT" then
+    print("Unsupported version.")
+    os.exit(0)
+end
+
+local ffi = require("ffi")
+local string_buf = require("string.buffer")
+
+local MB = 1024 * 1024
+local SIZE = (tonumber(os.getenv("BENCH_SIZE_MB")) or 64) * MB
+local CHUNK_SIZE = tonumber(os.getenv("BENCH_CHUNK_SIZE")) or 4096
+local NUM_CHUNKS = math.ceil(SIZE / CHUNK_SIZE)
+
+local chunk = ("0123456789abcdef"):rep(math.floor(CHUNK_SIZE / 16) + 1)
+chunk = chunk:sub(1, CHUNK_SIZE)
+local chunk_cdata = ffi.new("uint8_t[?]", CHUNK_SIZE)
+ffi.copy(chunk_cdata, chunk, CHUNK_SIZE)
+
+local function mb_per_sec(bytes, elapsed)
+    return elapsed > 0 and bytes / MB / elapsed or math.huge
+end
+
+local write_methods = {
+    put = function(b, tracker)
+        tracker:call(b.put, chunk)
+    end,
+    putcdata = function(b, tracker)
+        tracker:call(b.putcdata, chunk_cdata, CHUNK_SIZE)
+    end,
+    reserve = function(b, tracker)
+        local ptr = tracker:call(b.reserve, CHUNK_SIZE)
+        ffi.copy(ptr, chunk_cdata, CHUNK_SIZE)
+        b:commit(CHUNK_SIZE)
+    end,
+}
+
+local function bench_write(name, initial_size)
+    local write = write_methods[name]
+    local b = string_buf.new(initial_size)
+    local tracker = test_lib.buffer_tracker(b)
+    local start = os.clock()
+    for _ = 1, NUM_CHUNKS do
+        write(b, tracker)
+    end
+    local elapsed = os.clock() - start
+    print(("write %-8s initial size: %9d, %8.1f MB/s, moves: %3d, " ..
+           "moved: %6.1f MB"):format(name, initial_size or 0,
+           mb_per_sec(#b, elapsed), tracker.moves,
+           tracker.bytes_moved / MB))
+    return b
+end
+
+local function bench_read(b)
+    local len = #b
+    local start = os.clock()
+    while #b > 0 do
+        local ptr = b:ref()
+        assert(ptr[0] == chunk:byte(1))
+        b:skip(CHUNK_SIZE)
+    end
+    local elapsed = os.clock() - start
+    print(("read  ref/skip: %8.1f MB/s"):format(mb_per_sec(len, elapsed)))
+end
+
+local function bench_get(b)
+    local len = #b
+    local start = os.clock()
+    while #b > 0 do
+        b:get(CHUNK_SIZE)
+    end
+    local elapsed = os.clock() - start
+    print(("read  get:      %8.1f MB/s"):format(mb_per_sec(len, elapsed)))
+end
+
+local function bench_serialize()
+    local objects = {}
+    for i = 1, 1024 do
+        objects[i] = i % 2 == 0 and chunk:sub(1, i) or i * 1.5
+    end
+    local enc = string_buf.new()
+    local num_objects = 0
+    local start = os.clock()
+    while #enc < SIZE do
+        for i = 1, #objects do
+            enc:encode(objects[i])
+        end
+        num_objects = num_objects + #objects
+    end
+    local elapsed = os.clock() - start
+    local len = #enc
+    print(("encode:         %8.1f MB/s, %10.0f objects/s"):format(
+          mb_per_sec(len, elapsed), num_objects / elapsed))
+
+    local ptr = enc:ref()
+    local cdata = ffi.new("uint8_t[?]", len)
+    ffi.copy(cdata, ptr, len)
+    enc:free()
+    local dec = string_buf.new()
+    dec:set(cdata, len)
+    start = os.clock()
+    while #dec > 0 do
+        dec:decode()
+    end
+    elapsed = os.clock() - start
+    print(("decode:         %8.1f MB/s, %10.0f objects/s"):format(
+          mb_per_sec(len, elapsed), num_objects / elapsed))
+    dec:free()
+    assert(ffi.sizeof(cdata) == len)
+end
+
+for _, name in ipairs({ "put", "putcdata", "reserve" }) do
+    bench_write(name):free()
+    bench_write(name, SIZE):free()
+end
+bench_read(bench_write("reserve", SIZE))
+bench_get(bench_write("put", SIZE))
+bench_serialize()
@@ -0,0 +1,155 @@
+--[[
+SPDX-License-Identifier: ISC
+Copyright (c) 2023-2025, Sergey Bronnikov.
+
+String Buffer Library,
+https://luajit.org/ext_buffer.html
+
+The test writes a large stream to a string buffer with zero-copy
+methods `buf:reserve()`/`buf:commit()` and with `buf:put()`,
+`buf:putcdata()`, and reads it back with `buf:ref()` and
+`buf:skip()`. A stream of serialized objects is decoded from an
+FFI cdata object set by `buf:set()` without a copy.
+
+Synopsis:
+
+ptr, len = buf:reserve(size)
+buf = buf:commit(used)
+ptr, len = buf:ref()
+buf = buf:set(cdata, len)
+]]
+
+local luzer = require("luzer")
+local test_lib = require("lib")
+
+-- LuaJIT only.
+if test_lib.lua_version() ~= "LuaJIT" then
+    print("Unsupported version.")
+    os.exit(0)
+end
+
+local ffi = require("ffi")
+local string_buf = require("string.buffer")
+
+-- The maximum size of a chunk is 64Kb, the maximum number of
+-- chunks is 64, so a stream is up to 4Mb.
+local MAX_CHUNK_SIZE = 64 * 1024
+local MAX_CHUNKS = 64
+
+-- Returns a string of size `size` filled by a pattern.
+local function fill_chunk(pattern, size)
+    local n = math.ceil(size / #pattern)
+    return pattern:rep(n):sub(1, size)
+end
+
+local function write_reserve(b, tracker, chunk)
+    local ptr, len = tracker:call(b.reserve, #chunk)
+    assert(len >= #chunk)
+    ffi.copy(ptr, chunk, #chunk)
+    b:commit(#chunk)
+end
+
+local function write_put(b, tracker, chunk)
+    tracker:call(b.put, chunk)
+end
+
+local function write_putcdata(b, tracker, chunk)
+    local cdata = ffi.new("uint8_t[?]", #chunk)
+    ffi.copy(cdata, chunk, #chunk)
+    tracker:call(b.putcdata, cdata, #chunk)
+end
+
+local write_methods = {
+    write_putcdata,
+    write_put,
+    write_reserve,
+}
+
+local function test_stream(fdp, pattern)
+    local b = string_buf.new(fdp:consume_integer(1, MAX_CHUNK_SIZE))
+    local tracker = test_lib.buffer_tracker(b)
+    local chunks = {}
+    local num_chunks = fdp:consume_integer(1, MAX_CHUNKS)
+    for i = 1, num_chunks do
+        local chunk = fill_chunk(pattern,
+            fdp:consume_integer(1, MAX_CHUNK_SIZE))
+        local write = fdp:oneof(write_methods)
+        write(b, tracker, chunk)
+        chunks[i] = chunk
+    end
+    local expected = table.concat(chunks)
+
+    -- Read the stream without a copy.
+    local ptr, len = b:ref()
+    assert(len == #expected)
+    assert(ffi.string(ptr, len) == expected)
+
+    -- Consume the stream by parts.
+    local pos = 0
+    while #b > 0 do
+        -- At most `MAX_CHUNKS` steps, when data is exhausted.
+        local n = math.max(fdp:consume_integer(1, MAX_CHUNK_SIZE),
+                           math.ceil(#expected / MAX_CHUNKS))
+        b:skip(n)
+        pos = math.min(pos + n, #expected)
+        ptr, len = b:ref()
+        assert(len == #expected - pos)
+        if len > 0 then
+            assert(ffi.string(ptr, 1) == expected:sub(pos + 1, pos + 1))
+        end
+    end
+    -- Data moves are bounded by a geometric growth of a buffer.
+    assert(tracker.bytes_moved <= 2 * #expected + MAX_CHUNK_SIZE)
+    b:free()
+end
+
+local function test_decode_stream(fdp, pattern)
+    local enc = string_buf.new()
+    local objects = {}
+    local num_objects = fdp:consume_integer(1, MAX_CHUNKS)
+    for i = 1, num_objects do
+        local obj
+        if fdp:consume_boolean() then
+            obj = fill_chunk(pattern, fdp:consume_integer(1, MAX_CHUNK_SIZE))
+        else
+            obj = fdp:consume_number(test_lib.MIN_INT64, test_lib.MAX_INT64)
+        end
+        objects[i] = obj
+        enc:encode(obj)
+    end
+
+    -- `buf:set()` stores a reference to cdata, data is not copied.
+    local ptr, len = enc:ref()
+    local cdata = ffi.new("uint8_t[?]", len)
+    ffi.copy(cdata, ptr, len)
+    local dec = string_buf.new()
+    dec:set(cdata, len)
+    assert(dec:ref() == ffi.cast("uint8_t *", cdata))
+
+    local i = 0
+    while #dec > 0 do
+        i = i + 1
+        local obj = dec:decode()
+        assert(obj == objects[i])
+    end
+    assert(i == num_objects)
+    dec:free()
+    -- The cdata object must be alive while the buffer refers to it.
+    assert(ffi.sizeof(cdata) == len)
+    enc:free()
+end
+
+local function TestOneInput(buf, _size)
+    local fdp = luzer.FuzzedDataProvider(buf)
+    local pattern = fdp:consume_string(test_lib.MAX_STR_LEN)
+    if #pattern == 0 then
+        return -1
+    end
+    test_stream(fdp, pattern)
+    test_decode_stream(fdp, pattern)
+end
+
+local args = {
+    artifact_prefix = "string_buffer_zerocopy_",
+}
+luzer.Fuzz(TestOneInput, nil, args)
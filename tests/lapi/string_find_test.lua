@@ -20,6 +20,10 @@ Synopsis: string.find(s, pattern [, init [, plain]])
 local luzer = require("luzer")
 local test_lib = require("lib")
 
+-- Matching a pattern without backtracking is linear in a product
+-- of a string and a pattern lengths.
+local find = test_lib.complexity_oracle("string.find", "O(n)")
+
 local function TestOneInput(buf, _size)
     local fdp = luzer.FuzzedDataProvider(buf)
     os.setlocale(test_lib.random_locale(fdp), "all")
@@ -28,11 +32,16 @@ local function TestOneInput(buf, _size)
     local init = fdp:consume_integer(0, test_lib.MAX_INT)
     local plain = fdp:consume_boolean()
     -- Avoid errors like "malformed pattern (missing ']')".
-    local ok, _ = pcall(string.find, str, pattern, init, plain)
+    local size = #str * math.max(#pattern, 1)
+    local ok, begin_pos, end_pos = pcall(string.find, str, pattern,
+                                         init, plain)
     if not ok then
         return
     end
-    local begin_pos, end_pos = string.find(str, pattern, init, plain)
+    if test_lib.complexity_oracle_is_enabled() then
+        begin_pos, end_pos = find(size, string.find, str, pattern,
+                                  init, plain)
+    end
     -- `string.format()` returns two numbers or "fail".
     assert((type(begin_pos) == "number" and type(end_pos) == "number") or
            (begin_pos == nil or end_pos == nil) or
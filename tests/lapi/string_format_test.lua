@@ -69,7 +69,7 @@ local function TestOneInput(buf, _size)
     local format_string = ("%%%s"):format(spec)
     local str = fdp:consume_string(test_lib.MAX_STR_LEN)
 
-    os.setlocale(test_lib.random_locale(fdp), "all")
+    test_lib.setlocale(test_lib.random_locale(fdp))
     local ok, res = pcall(string.format, format_string, str)
     assert(type(res) == "string")
     if ok then
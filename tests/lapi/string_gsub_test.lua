@@ -21,6 +21,10 @@ Synopsis: string.gsub(s, pattern, repl [, n])
 local luzer = require("luzer")
 local test_lib = require("lib")
 
+-- Matching a pattern without backtracking is linear in a product
+-- of a string and a pattern lengths.
+local gsub = test_lib.complexity_oracle("string.gsub", "O(n)")
+
 local function TestOneInput(buf, _size)
     local fdp = luzer.FuzzedDataProvider(buf)
     local str = fdp:consume_string(test_lib.MAX_STR_LEN)
@@ -30,10 +34,15 @@ local function TestOneInput(buf, _size)
 
     os.setlocale(test_lib.random_locale(fdp), "all")
     -- Avoid errors like "malformed pattern (missing ']')".
+    local size = #str * math.max(#pattern, 1)
     local ok, res = pcall(string.gsub, str, pattern, repl, n)
-    if ok then
-        assert(type(res) == "string")
+    if not ok then
+        return
+    end
+    if test_lib.complexity_oracle_is_enabled() then
+        res = gsub(size, string.gsub, str, pattern, repl, n)
     end
+    assert(type(res) == "string")
 end
 
 local args = {
@@ -14,6 +14,8 @@ Synopsis: string.rep(s, n [, sep])
 local luzer = require("luzer")
 local test_lib = require("lib")
 
+local rep = test_lib.complexity_oracle("string.rep", "O(n)")
+
 local function TestOneInput(buf, _size)
     local fdp = luzer.FuzzedDataProvider(buf)
     os.setlocale(test_lib.random_locale(fdp), "all")
@@ -21,11 +23,18 @@ local function TestOneInput(buf, _size)
     local n = fdp:consume_integer(1, test_lib.MAX_STR_LEN)
     local s = fdp:consume_string(test_lib.MAX_STR_LEN)
     local sep = fdp:consume_string(test_lib.MAX_STR_LEN)
-    local len = string.len(string.rep(s, n, sep))
-    assert(len == #s * n + #sep * (n - 1))
+    local res_len = #s * n + #sep * (n - 1)
+    local len = string.len(rep(res_len, string.rep, s, n, sep))
+    assert(len == res_len)
 end
 
 local args = {
     artifact_prefix = "string_rep_",
 }
-luzer.Fuzz(TestOneInput, nil, args)
+-- A result is up to `n` times longer than strings taken from
+-- an input, a buffer used to build the result is reallocated
+-- with doubling.
+local memory_opts = {
+    peak_ratio = 4 * test_lib.MAX_STR_LEN,
+}
+luzer.Fuzz(test_lib.memory_oracle(TestOneInput, memory_opts), nil, args)
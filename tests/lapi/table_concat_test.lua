@@ -14,6 +14,8 @@ Synopsis: table.concat(list [, sep [, i [, j]]])
 local luzer = require("luzer")
 local test_lib = require("lib")
 
+local concat = test_lib.complexity_oracle("table.concat", "O(n)")
+
 local function TestOneInput(buf, _size)
     local fdp = luzer.FuzzedDataProvider(buf)
     local str = fdp:consume_string(test_lib.MAX_STR_LEN)
@@ -31,7 +33,7 @@ local function TestOneInput(buf, _size)
     local j = fdp:consume_integer(1, tbl_size)
     local i = fdp:consume_integer(1, j)
     local sep = ""
-    assert(string.sub(str, i, j) == table.concat(tbl, sep, i, j))
+    assert(string.sub(str, i, j) == concat(j - i + 1, table.concat, tbl, sep, i, j))
 end
 
 local args = {
@@ -35,4 +35,4 @@ end
 local args = {
     artifact_prefix = "table_move_",
 }
-luzer.Fuzz(TestOneInput, nil, args)
+luzer.Fuzz(test_lib.memory_oracle(TestOneInput), nil, args)
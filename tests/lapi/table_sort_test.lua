@@ -17,6 +17,19 @@ local test_lib = require("lib")
 local MIN_INT = test_lib.MIN_INT64
 local MAX_INT = test_lib.MAX_INT64
 
+local sort = test_lib.complexity_oracle("table.sort", "O(n log n)", {
+    metric = "instructions",
+})
+
+-- The complexity oracle counts VM instructions executed by
+-- a comparator written in Lua.
+local lt
+if test_lib.complexity_oracle_is_enabled() then
+    lt = function(a, b)
+        return a < b
+    end
+end
+
 local function random_table(fdp, n)
     local count = fdp:consume_integer(0, n)
     local item_type = fdp:oneof({ "number", "string" })
@@ -37,7 +50,7 @@ local function TestOneInput(buf, _size)
     local MAX_N = 1000
     local t = random_table(fdp, MAX_N)
     local len = #t
-    table.sort(t)
+    sort(len, table.sort, t, lt)
     assert(len == #t)
 
     for i = 1, len - 1 do